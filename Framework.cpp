@@ -2,31 +2,99 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
 #include "framework.hpp"
+#include "trace.h"
+#include "trace_map.h"
+#include "trace_index.h"
+#include "timing.h"
+#include "estimate.h"
+#include "result_cache.h"
 
 using namespace std;
 
-extern "C" {
-	#include "WK.h"
-	#include "lzoconf.h"
-}
 
 
 /*
  * Compile instructions:
- * g++ -c Framework.cpp -o Framework.o
+ * g++ -c -I. -I./lzo Framework.cpp -o Framework.o
  * gcc -c -std=c99 WK.c -o WK.o
+ * gcc -c -std=c99 -DWK_VARIANT=$v WK.c -o WK_$v.o, for each variant $v listed in WK_variants.h
+ * gcc -c -std=c99 WK_variants.c -o WK_variants.o
  * gcc -c -I. -I./lzo -s -Wall -O2 -fomit-frame-pointer minilzo.c -o minilzo.o
  * gcc -c lzo1.c -o lzo1.o
- * gcc -c lzo_init.c -o lzo_init.o
- * g++ -o Framework Framework.o WK.o minilzo.o
- * 					OR
- * g++ -o Framework Framework.o WK.o lzo1.o lzo_init.o
+ * g++ -o Framework Framework.o WK.o WK_*.o lzo1.o minilzo.o -lpthread
+ *
+ * minilzo.o also provides lzo_init(), so lzo_init.o is no longer linked in.
+ *
+ * Usage:
+ * ./Framework [-c codec[:cache],...] [-j threads] [-B] [-t clock|tsc] [-r repeats] [-s min|median] [-p] [-C warm|cold|ring] [-e] [-m pages] [-z]
+ *             [--start-chunk A] [--end-chunk B] [--resume] trace results
+ *
+ * Every page of the trace is compressed and decompressed with each selected
+ * codec (all of them by default) in a single pass, and the results file holds
+ * one column of sizes and times per codec. Pick a column in Simulator by name.
+ * Pages are compressed by -j worker threads (one per core by default) and
+ * written in trace order. Each compression and decompression is timed on its
+ * own unless -B is given, in which case codecs take pages in batches and every
+ * page is charged an equal share of its batch's time.
+ *
+ * Times come from the thread's CPU clock, or with -t tsc from the time stamp
+ * counter (see timing.h). With -r K every call is made K times and recorded
+ * as the minimum, or with -s median the median, of the K runs. -p pins each
+ * worker to its own core.
+ *
+ * Codecs are timed warm by default: the page was just read and the output of
+ * compression is still in L1 when it is decompressed. -C cold flushes the page
+ * and all buffers from cache before every call; -C ring instead rotates the
+ * output buffers through a ring much larger than the cache. A cache state can
+ * also be given per codec, so -c wk,wk:cold yields a warm and a cold column
+ * (named wk and wk:cold) from the same run.
+ *
+ * Besides wk, which is WK as compiled into WK.o, each variant of WK listed in
+ * WK_variants.h is a codec named after the variant, e.g. wk4x4_l12 for a 4x4
+ * dictionary and 12 low bits. They are not run by default; -c wk* runs all of
+ * them, to sweep WK's parameters over a trace in one run.
+ *
+ * -e also predicts the size of every page with estimate.h, without
+ * compressing it, and reports how far the predictions were from the sizes the
+ * codecs actually reached and how long the estimator took per page. Pages are
+ * estimated before any codec runs, so that time includes bringing each page
+ * into cache.
+ *
+ * -m N keeps the results of up to N distinct pages in a cache keyed by their
+ * contents (see result_cache.h), and serves repeated pages from it without
+ * compressing them again. A served page is charged the times measured for the
+ * first copy, so -m is for sweeps over compression ratios rather than timing.
+ *
+ * -z records only the size of every page, with times of 0. WK and its variants
+ * then model each page without writing its compressed form, which measured
+ * 1.0-1.3x as fast as compressing with two-pass packing and up to 2x as fast
+ * as fused packing; other codecs still compress it. Pages are not decompressed.
+ *
+ * --start-chunk and --end-chunk limit the run to chunks [A, B) of the trace,
+ * TRACE_INDEX_CHUNK records each, found through the index kept next to the
+ * trace (see trace_index.h; it is built on first use). Disjoint ranges can be
+ * run side by side, and their results joined by appending the records of each
+ * file after the first, i.e. everything past the header and codec table.
+ * --resume picks up a run that was stopped: the records already in the
+ * results file are kept and the run continues after them. Give it the same
+ * codecs and range as the run it resumes.
  */
 
 
 int PAGE_SIZE = 4096;
+
+// Largest run of pages a worker hands to a codec at once
+#define BATCH_PAGES 64
+// Size of each worker's ring of output buffers for columns timed with -C ring,
+// well beyond the last level cache
+#define CACHE_RING_BYTES (64 << 20)
 //int WORDS_PER_PAGE = PAGE_SIZE/sizeof(WK_word);
 
 //================================= Extras for minilzo =====================================
@@ -43,30 +111,21 @@ typedef struct {
 
 static mblock_t block_w;        /* wrkmem */
 
-typedef struct
-{
-    const char *            name;
-    int                     id;
-    lzo_uint32_t            mem_compress;
-    lzo_uint32_t            mem_decompress;
-    lzo_compress_t          compress;
-    lzo_optimize_t          optimize;
-    lzo_decompress_t        decompress;
-    lzo_decompress_t        decompress_safe;
-    lzo_decompress_t        decompress_asm;
-    lzo_decompress_t        decompress_asm_safe;
-    lzo_decompress_t        decompress_asm_fast;
-    lzo_decompress_t        decompress_asm_fast_safe;
-    lzo_compress_dict_t     compress_dict;
-    lzo_decompress_dict_t   decompress_dict_safe;
-} compress_t;
-
-/* Work-memory needed for compression. Allocate memory in units
- * of 'lzo_align_t' (instead of 'char') to make sure it is properly aligned.
- */
+// LZO's work memory, allocated in units of 'lzo_align_t' (instead of 'char')
+// to make sure it is properly aligned.
+lzo_voidp allocWorkMemory(lzo_uint32_t size){
+	return malloc(((size) + (sizeof(lzo_align_t) - 1)) / sizeof(lzo_align_t) * sizeof(lzo_align_t));
+}
 
-#define HEAP_ALLOC(var,size) \
-    lzo_align_t __LZO_MMODEL var [ ((size) + (sizeof(lzo_align_t) - 1)) / sizeof(lzo_align_t) ]
+// Initialize the LZO library. Done once per codec instance, i.e. per worker
+// thread, so that no page pays for it.
+void initLZO(){
+    if (lzo_init() != LZO_E_OK){
+        printf("internal error - lzo_init() failed !!!\n");
+        printf("(this usually indicates a compiler bug - try recompiling\nwithout optimizations, and enable `-DLZO_DEBUG' for diagnostics)\n");
+        exit(1);
+    }
+}
 
 //==========================================================================================
 
@@ -102,50 +161,58 @@ WK_word * PassthroughAlgo::decompress(WK_word *src, WK_word *dst, unsigned int s
 }
 
 
+WKAlgo::WKAlgo(){
+	context = WK_context_create(WORDS_PER_PAGE);
+	if (context == NULL){
+		printf("internal error - unable to allocate WK's context\n");
+		exit(1);
+	}
+}
+
+WKAlgo::~WKAlgo(){
+	WK_context_destroy(context);
+}
+
 WK_word * WKAlgo::compress(WK_word *src, WK_word *dst, unsigned int numWords){
-	return WK_compress(src, dst, numWords);
+	return WK_compress_ctx(context, src, dst, numWords);
 }
 
 WK_word * WKAlgo::decompress(WK_word *src, WK_word *dst, unsigned int size){
-	return WK_decompress(src, dst);
+	return WK_decompress_ctx(context, src, dst);
+}
+
+WK_word * WKAlgo::compressWithin(WK_word *src, WK_word *dst, unsigned int numWords, unsigned int maxBytes){
+	return WK_compress_ctx_budget(context, src, dst, numWords, maxBytes);
+}
+
+unsigned int WKAlgo::compressedSize(WK_word *src, WK_word *dst, unsigned int numWords){
+	return WK_compressed_size(src, numWords);
 }
 
 
-#ifdef MINI
-// Requires much more work to convert to something that can play nice with miniLZO
 // r = lzo1x_1_compress(in,in_len,out,&out_len,wrkmem): 
 // lzo_bytep, lzo_uint, lzo_bytep, lzo_uintp, lzo_voidp
 // unsigned char *, unsigned int64, unsigned char *, &(unsigned int64), void * 
 
-WK_word * minilzoAlgo::compress(WK_word *src, WK_word *dst, unsigned int numWords){
+minilzoAlgo::minilzoAlgo(){
+	initLZO();
+	wrkmem = allocWorkMemory(LZO1X_1_MEM_COMPRESS);
+}
 
-//
-// Step 1: initialize the LZO library
-//
-    if (lzo_init() != LZO_E_OK){
-        printf("internal error - lzo_init() failed !!!\n");
-        printf("(this usually indicates a compiler bug - try recompiling\nwithout optimizations, and enable '-DLZO_DEBUG' for diagnostics)\n");
-        return NULL;
-    }
+minilzoAlgo::~minilzoAlgo(){
+	free(wrkmem);
+}
 
+WK_word * minilzoAlgo::compress(WK_word *src, WK_word *dst, unsigned int numWords){
 	lzo_bytep input_buf = (lzo_bytep)src;
 	lzo_bytep output_buf = (lzo_bytep)dst;
 	lzo_uint input_length = numWords*sizeof(WK_word);
 	lzo_uint output_length;
-	HEAP_ALLOC(wrkmem, LZO1X_1_MEM_COMPRESS);
-
-	int return_val = lzo1x_1_compress(input_buf, input_length, output_buf, &output_length, wrkmem);
-    if (return_val == LZO_E_OK)
-    	printf("Algo compressed %lu bytes into %lu bytes\n", (unsigned long) input_length, (unsigned long) output_length);
-    else{
-        // this should NEVER happen
-        printf("internal error - compression failed: %d\n", return_val);
-        return NULL;
-    }
 
+	error = lzo1x_1_compress(input_buf, input_length, output_buf, &output_length, wrkmem);
+	if (error != LZO_E_OK)
+        return NULL;
 
-    src = (WK_word *)input_buf;
-    dst = (WK_word *)output_buf;
     WK_word *dst_len =(WK_word *) ((char *)dst + output_length);
     return dst_len;
 }
@@ -156,53 +223,33 @@ WK_word * minilzoAlgo::decompress(WK_word *src, WK_word *dst, unsigned int size)
 	lzo_uint input_length = size;
 	lzo_uint output_length;
 
-	int return_val = lzo1x_decompress(input_buf,input_length,output_buf,&output_length,NULL);
-
-	if (return_val == LZO_E_OK)
-        printf("Algo decompressed %lu bytes back into %lu bytes\n", (unsigned long) output_length, (unsigned long) input_length);
-    else{
-        // this should NEVER happen
-        printf("internal error - decompression failed: %d\n", return_val);
+	error = lzo1x_decompress(input_buf,input_length,output_buf,&output_length,NULL);
+	if (error != LZO_E_OK)
         return NULL;
-    }
 
-    src = (WK_word *)input_buf;
-    dst = (WK_word *)output_buf;
     WK_word *dst_len = dst + (output_length/sizeof(lzo_bytep));
     return dst_len;
 }
 
-#else
-WK_word * lzo1Algo::compress(WK_word *src, WK_word *dst, unsigned int numWords){
-
-	if (lzo_init() != LZO_E_OK){
-        printf("internal error - lzo_init() failed !!!\n");
-        printf("(this usually indicates a compiler bug - try recompiling\nwithout optimizations, and enable `-DLZO_DEBUG' for diagnostics)\n");
-        exit(1);
-    }
-
-    const compress_t c = { "LZO1-1", 21, LZO1_MEM_COMPRESS, LZO1_MEM_DECOMPRESS, lzo1_compress, 0, lzo1_decompress, 0, 0, 0, 0, 0, 0, 0};
-
-    HEAP_ALLOC(wrkmem, c.mem_compress);
+lzo1Algo::lzo1Algo(){
+	initLZO();
+	wrkmem = allocWorkMemory(LZO1_MEM_COMPRESS);
+}
 
+lzo1Algo::~lzo1Algo(){
+	free(wrkmem);
+}
 
+WK_word * lzo1Algo::compress(WK_word *src, WK_word *dst, unsigned int numWords){
 	lzo_bytep input_buf = (lzo_bytep)src;
 	lzo_bytep output_buf = (lzo_bytep)dst;
 	lzo_uint input_length = numWords*sizeof(WK_word);
 	lzo_uint output_length;
 
-	int return_val = lzo1_compress(input_buf, input_length, output_buf, &output_length, wrkmem);
-	if (return_val == LZO_E_OK);
-      //printf("Algo compressed %lu bytes into %lu bytes\n", (unsigned long) input_length, (unsigned long) output_length);
-    else{
-        /* this should NEVER happen */
-        printf("internal error - compression failed: %d\n", return_val);
+	error = lzo1_compress(input_buf, input_length, output_buf, &output_length, wrkmem);
+	if (error != LZO_E_OK)
         return NULL;
-    }
-
 
-    src = (WK_word *)input_buf;
-    dst = (WK_word *)output_buf;
     WK_word *dst_len =(WK_word *) ((char *)dst + output_length);
     return dst_len;
 }
@@ -214,124 +261,959 @@ WK_word * lzo1Algo::decompress(WK_word *src, WK_word *dst, unsigned int size){
 	lzo_uint input_length = size;
 	lzo_uint output_length;
 
-	int return_val = lzo1_decompress(input_buf,input_length,output_buf,&output_length,NULL);
-
-	if (return_val == LZO_E_OK);
-	  //printf("Algo decompressed %lu bytes back into %lu bytes\n", (unsigned long) output_length, (unsigned long) input_length);
-    else{
-        /* this should NEVER happen */
-        printf("internal error - decompression failed: %d\n", return_val);
+	error = lzo1_decompress(input_buf,input_length,output_buf,&output_length,NULL);
+	if (error != LZO_E_OK)
         return NULL;
-    }
 
-    src = (WK_word *)input_buf;
-    dst = (WK_word *)output_buf;
     WK_word *dst_len = dst + (output_length/sizeof(lzo_bytep));
     return dst_len;
 }
-#endif
 
-struct timespec diff(struct timespec start, struct timespec end)
-{
-  struct timespec temp;
-  if ((end.tv_nsec-start.tv_nsec)<0) {
-    temp.tv_sec = end.tv_sec-start.tv_sec-1;
-    temp.tv_nsec = 1000000000+end.tv_nsec-start.tv_nsec;
-  } else {
-    temp.tv_sec = end.tv_sec-start.tv_sec;
-    temp.tv_nsec = end.tv_nsec-start.tv_nsec;
-  }
-  return temp;
+//================================= Adaptive codec =========================================
+//
+// Output is a tag naming the codec that was used, then that codec's output.
+// The tag takes a whole word in front of WK output, which must stay word
+// aligned, and a single byte in front of everything else. Zero pages are the
+// tag alone, followed by their length in words when they are shorter than a
+// page. A page is stored raw whenever its codec fails to shrink it.
+
+#define ADAPTIVE_RAW_ENTROPY   7.0      // bits per byte beyond which a page is not worth compressing
+
+// Decide how to compress a page from its sketch (see estimate.h):
+//   - zero words, and words whose high bits match a recent word, are what WK
+//     encodes in a few bits, so pages with many of them go to WK;
+//   - pages whose sampled bytes look random are stored raw;
+//   - the rest, byte-oriented data such as text, goes to miniLZO, which beat
+//     lzo1 on both ratio and speed on every trace tried. lzo1 keeps its tag so
+//     that the choice can be revisited without changing the format, but is
+//     left out of the codec until it can be chosen.
+int AdaptiveAlgo::choose(WK_word *src, unsigned int numWords){
+	page_sketch sketch;
+	estimate_sketch(src, numWords, &sketch);
+
+	if (sketch.zeros == sketch.samples){
+		for (unsigned int i = 0; i < numWords; i++)
+			if (src[i] != 0)
+				return ADAPTIVE_WK;
+		return ADAPTIVE_ZERO;
+	}
+	if (2*(sketch.zeros + sketch.exact + sketch.partial) >= sketch.samples)
+		return ADAPTIVE_WK;
+	if (sketch.zeros == 0 && estimate_entropy(&sketch) > ADAPTIVE_RAW_ENTROPY)
+		return ADAPTIVE_RAW;
+	return ADAPTIVE_MINILZO;
 }
 
+WK_word * AdaptiveAlgo::compress(WK_word *src, WK_word *dst, unsigned int numWords){
+	unsigned char *tag = (unsigned char *)dst;
+	char *end = NULL;
+	*tag = choose(src, numWords);
+
+	switch (*tag){
+	case ADAPTIVE_ZERO:
+		if (numWords == WORDS_PER_PAGE)
+			return (WK_word *)(tag + 1);
+		memcpy(tag + 1, &numWords, sizeof(numWords));
+		return (WK_word *)(tag + 1 + sizeof(numWords));
+	case ADAPTIVE_WK:
+		// Stop WK as soon as the page is sure not to shrink, and store it raw
+		end = (char *)wk.compressWithin(src, dst + 1, numWords, (numWords - 1)*sizeof(WK_word) - 1);
+		break;
+	case ADAPTIVE_MINILZO:
+		end = (char *)minilzo.minilzoAlgo::compress(src, (WK_word *)(tag + 1), numWords);
+		break;
+	}
 
-int main(int argc, char *argv[]){
+	if (end == NULL || end - (char *)dst >= (long)(numWords*sizeof(WK_word))){
+		*tag = ADAPTIVE_RAW;
+		memcpy(tag + 1, src, numWords*sizeof(WK_word));
+		end = (char *)(tag + 1) + numWords*sizeof(WK_word);
+	}
+	return (WK_word *)end;
+}
 
-	if (argc != 3){
-		printf("Invalid use of command. Include one input file and one output file. Include final param for lzo1.\n");
-		return -1;
+WK_word * AdaptiveAlgo::decompress(WK_word *src, WK_word *dst, unsigned int size){
+	unsigned char *tag = (unsigned char *)src;
+
+	switch (*tag){
+	case ADAPTIVE_ZERO:{
+		unsigned int numWords = WORDS_PER_PAGE;
+		if (size > 1)
+			memcpy(&numWords, tag + 1, sizeof(numWords));
+		memset(dst, 0, numWords*sizeof(WK_word));
+		return dst + numWords;
+	}
+	case ADAPTIVE_RAW:
+		memcpy(dst, tag + 1, size - 1);
+		return dst + (size - 1)/sizeof(WK_word);
+	case ADAPTIVE_WK:
+		return wk.WKAlgo::decompress(src + 1, dst, size - sizeof(WK_word));
+	case ADAPTIVE_MINILZO:
+		return minilzo.minilzoAlgo::decompress((WK_word *)(tag + 1), dst, size - 1);
+	}
+	error = *tag;
+	return NULL;
+}
+
+//================================= Timing drivers =========================================
+//
+// One copy of each loop is compiled per codec, calling it without virtual
+// dispatch. A worker picks the driver once per run of pages. Every call is
+// made timer.repeats times and summarized as timing.h describes; the output of
+// the last compression is the one decompressed.
+
+timing_engine timer;
+
+// Times every compression and decompression of every page on its own.
+template <class Codec>
+void timeEachPage(CompressionAlgo *algo, const char *name, page_run *run){
+	Codec *codec = static_cast<Codec *>(algo);
+	int64_t samples[TIMING_MAX_REPEATS];
+	WK_word *dest_end = NULL;
+	WK_word *udest_end;
+	unsigned int size;
+
+	for (int k = 0; k < run->count; k++){
+		codec_result *result = run->results[k] + run->column;
+		WK_word *dest = run->dest_area + k*2*WORDS_PER_PAGE;
+		WK_word *udest = run->udest_area + k*WORDS_PER_PAGE;
+
+		for (int r = 0; r < timer.repeats; r++){
+			if (run->cache == CACHE_COLD){
+				timing_evict(run->srcs[k], PAGE_SIZE);
+				timing_evict(dest, 2*PAGE_SIZE);
+			}
+			uint64_t start = timing_start(&timer);
+			dest_end = codec->Codec::compress(run->srcs[k], dest, WORDS_PER_PAGE);
+			samples[r] = timing_stop(&timer) - start;
+			if (dest_end == NULL){
+				/* this should NEVER happen */
+				printf("internal error - %s compression failed: %d\n", name, codec->error);
+				exit(1);
+			}
+		}
+		size = ((char *)dest_end - (char *)dest);
+
+		result->comp_size += size;
+		result->comp_time += timing_summarize(&timer, samples, timer.repeats);
+
+		for (int r = 0; r < timer.repeats; r++){
+			if (run->cache == CACHE_COLD){
+				timing_evict(dest, size);
+				timing_evict(udest, PAGE_SIZE);
+			}
+			uint64_t start = timing_start(&timer);
+			udest_end = codec->Codec::decompress(dest, udest, size);
+			samples[r] = timing_stop(&timer) - start;
+			if (udest_end == NULL){
+				/* this should NEVER happen */
+				printf("internal error - %s decompression failed: %d\n", name, codec->error);
+				exit(1);
+			}
+		}
+
+		result->decomp_time += timing_summarize(&timer, samples, timer.repeats);
+	}
+}
+
+// Compresses the whole run with one batch call, then decompresses it with
+// another, and shares the time of each call evenly among the pages. Sizes
+// stay exact.
+template <class Codec>
+void timeWholeRun(CompressionAlgo *algo, const char *name, page_run *run){
+	Codec *codec = static_cast<Codec *>(algo);
+	int64_t samples[TIMING_MAX_REPEATS];
+	WK_word *dsts[BATCH_PAGES], *ends[BATCH_PAGES];
+	WK_word *udsts[BATCH_PAGES], *uends[BATCH_PAGES];
+	unsigned int sizes[BATCH_PAGES];
+	int n = run->count;
+
+	for (int k = 0; k < n; k++){
+		dsts[k] = run->dest_area + k*2*WORDS_PER_PAGE;
+		udsts[k] = run->udest_area + k*WORDS_PER_PAGE;
 	}
 
-	struct timespec start_time, end_time, total_time;
+	for (int r = 0; r < timer.repeats; r++){
+		if (run->cache == CACHE_COLD)
+			for (int k = 0; k < n; k++){
+				timing_evict(run->srcs[k], PAGE_SIZE);
+				timing_evict(dsts[k], 2*PAGE_SIZE);
+			}
+		uint64_t start = timing_start(&timer);
+		int done = codec->Codec::compressBatch(run->srcs, dsts, ends, WORDS_PER_PAGE, n);
+		samples[r] = timing_stop(&timer) - start;
+		if (done != n){
+			/* this should NEVER happen */
+			printf("internal error - %s compression failed: %d\n", name, codec->error);
+			exit(1);
+		}
+	}
+	long long comp_time = timing_summarize(&timer, samples, timer.repeats);
+	for (int k = 0; k < n; k++)
+		sizes[k] = (char *)ends[k] - (char *)dsts[k];
+
+	for (int r = 0; r < timer.repeats; r++){
+		if (run->cache == CACHE_COLD)
+			for (int k = 0; k < n; k++){
+				timing_evict(dsts[k], sizes[k]);
+				timing_evict(udsts[k], PAGE_SIZE);
+			}
+		uint64_t start = timing_start(&timer);
+		int done = codec->Codec::decompressBatch(dsts, udsts, sizes, uends, n);
+		samples[r] = timing_stop(&timer) - start;
+		if (done != n){
+			/* this should NEVER happen */
+			printf("internal error - %s decompression failed: %d\n", name, codec->error);
+			exit(1);
+		}
+	}
+	long long decomp_time = timing_summarize(&timer, samples, timer.repeats);
+
+	for (int k = 0; k < n; k++){
+		codec_result *result = run->results[k] + run->column;
+		result->comp_size += sizes[k];
+		// the last page takes the remainder, so that totals stay exact
+		result->comp_time += comp_time/n + (k == n - 1 ? comp_time%n : 0);
+		result->decomp_time += decomp_time/n + (k == n - 1 ? decomp_time%n : 0);
+	}
+}
 
+// Records the size of every page and no times, for -z.
+template <class Codec>
+void sizeEachPage(CompressionAlgo *algo, const char *name, page_run *run){
+	Codec *codec = static_cast<Codec *>(algo);
+
+	for (int k = 0; k < run->count; k++){
+		codec_result *result = run->results[k] + run->column;
+		unsigned int size = codec->Codec::compressedSize(run->srcs[k], run->dest_area + k*2*WORDS_PER_PAGE, WORDS_PER_PAGE);
+		if (size == 0){
+			/* this should NEVER happen */
+			printf("internal error - %s compression failed: %d\n", name, codec->error);
+			exit(1);
+		}
+		result->comp_size += size;
+	}
+}
 
-	WKAlgo test;
+//================================= Codec registry =========================================
+
+#define REGISTER_CODEC(name, Algo, estimate) {name, createCodec<Algo>, timeEachPage<Algo>, timeWholeRun<Algo>, sizeEachPage<Algo>, estimate}
+
+// Every codec Framework can run. Without -c all of them run, in this order.
+codec_entry codec_registry[] = {
+	REGISTER_CODEC("passthrough", PassthroughAlgo, ESTIMATE_NONE),
+	REGISTER_CODEC("wk",          WKAlgo,          ESTIMATE_WK),
+	REGISTER_CODEC("lzo1",        lzo1Algo,        ESTIMATE_LZ),
+	REGISTER_CODEC("minilzo",     minilzoAlgo,     ESTIMATE_LZ),
+	REGISTER_CODEC("adaptive",    AdaptiveAlgo,    ESTIMATE_BEST),
+};
+const int NUM_REGISTERED = sizeof(codec_registry)/sizeof(codec_entry);
+
+// The WK variants, in the order of WK_variants.h. Only run when named.
+#define REGISTER_WK_VARIANT(name) \
+	REGISTER_CODEC(#name, WKVariantAlgo<WK_VARIANT_SYMBOL(WK_variant_index, name)>, ESTIMATE_NONE),
+codec_entry wk_variant_registry[] = {
+	WK_VARIANTS(REGISTER_WK_VARIANT)
+};
+
+codec_entry *findCodec(const char *name){
+	for (int i = 0; i < NUM_REGISTERED; i++)
+		if (strcmp(codec_registry[i].name, name) == 0)
+			return &codec_registry[i];
+	for (int i = 0; i < WK_NUM_VARIANTS; i++)
+		if (strcmp(wk_variant_registry[i].name, name) == 0)
+			return &wk_variant_registry[i];
+	return NULL;
+}
 
+// Fill codecs from a comma separated list of names, or with every registered
+// codec if list is NULL. Returns the number selected, or -1 for an unknown name.
+const char *cache_names[] = {"warm", "cold", "ring"};
 
-	WK_word* addr;
-	WK_word* src_buf;
-	WK_word* dest_buf;
-	WK_word* udest_buf;
-	WK_word* dest_end;
-	WK_word* udest_end;
-	unsigned int size;
-	int i;
-	addr = (WK_word *)malloc(sizeof(WK_word));
-	src_buf = (WK_word*)malloc(PAGE_SIZE);
-	dest_buf = (WK_word*)malloc(PAGE_SIZE*2);
-	udest_buf = (WK_word*)malloc(PAGE_SIZE);
+int findCacheMode(const char *name){
+	for (int i = 0; i < 3; i++)
+		if (strcmp(cache_names[i], name) == 0)
+			return i;
+	return -1;
+}
 
+// A column of the results: a codec and the cache state it is timed in. The
+// column is named after the codec, with the cache state appended unless it is
+// warm, e.g. wk or wk:cold.
+typedef struct{
+  codec_entry *codec;
+  int         cache;
+  char        name[RESULTS_CODEC_NAME_LEN + 1];
+} codec_column;
+
+int addColumn(codec_column *column, codec_entry *codec, int cache){
+	column->codec = codec;
+	column->cache = cache;
+	if (cache == CACHE_WARM)
+		snprintf(column->name, sizeof(column->name), "%s", codec->name);
+	else
+		snprintf(column->name, sizeof(column->name), "%s:%s", codec->name, cache_names[cache]);
+	return strlen(codec->name) + (cache == CACHE_WARM ? 0 : 1 + strlen(cache_names[cache])) <= RESULTS_CODEC_NAME_LEN;
+}
 
-	FILE *infile = fopen(argv[1], "r");
-	if(infile == NULL){
-		printf("Invalid file name.\n");
-		return -2;
+// Fill columns from a comma separated list of codec[:cache] names, or with
+// every registered codec if list is NULL. wk* stands for every WK variant.
+// Columns without a cache state are timed in default_cache. Returns the
+// number selected, or -1 for a bad name.
+int selectCodecs(char *list, int default_cache, codec_column *columns){
+	int num = 0;
+	if (list == NULL){
+		for (int i = 0; i < NUM_REGISTERED && i < RESULTS_MAX_CODECS; i++)
+			addColumn(&columns[num++], &codec_registry[i], default_cache);
+		return num;
 	}
+	for (char *name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")){
+		int cache = default_cache;
+		char *mode = strchr(name, ':');
+		if (mode != NULL){
+			*mode++ = '\0';
+			cache = findCacheMode(mode);
+		}
+		if (strcmp(name, "wk*") == 0 && cache >= 0){
+			for (int i = 0; i < WK_NUM_VARIANTS; i++){
+				if (num == RESULTS_MAX_CODECS || !addColumn(&columns[num], &wk_variant_registry[i], cache)){
+					printf("Too many codecs, or a name too long: %s\n", wk_variant_registry[i].name);
+					return -1;
+				}
+				num++;
+			}
+			continue;
+		}
+		codec_entry *codec = findCodec(name);
+		if (codec == NULL || cache < 0 || num == RESULTS_MAX_CODECS || !addColumn(&columns[num], codec, cache)){
+			printf("Unknown codec: %s%s%s\n", name, mode != NULL ? ":" : "", mode != NULL ? mode : "");
+			return -1;
+		}
+		num++;
+	}
+	return num;
+}
+
+//================================= Pipeline ===============================================
+//
+// The main thread walks the mapped trace, collecting pointers to units into
+// batches, and queues them for a pool of workers, each with its own codec
+// instances and buffers. Codecs compress straight from the mapping. A writer
+// thread takes finished batches back in trace order, writes their records and
+// keeps the totals. Batches come from a fixed pool, so a slow writer or a slow
+// worker stalls the reader instead of letting batches pile up in memory.
+
+#define BATCH_UNITS 64
+
+typedef struct {
+  long long    seq;            // position of the batch in the trace
+  int          count;          // units held
+  uint64_t     end;            // offset in the trace just past the last unit
+  page_record  *records;       // BATCH_UNITS
+  const WK_word **units;       // BATCH_UNITS units of unit_size bytes, in the mapping
+  codec_result *results;       // BATCH_UNITS rows of num_codecs results
+  page_estimate *estimates;    // BATCH_UNITS predictions, with -e
+  long long    estimate_time;  // spent on the predictions
+} batch;
+
+// Bounded FIFO of batches. pop() returns NULL once the queue is closed and empty.
+typedef struct {
+  batch           **items;
+  int             capacity;
+  int             head;
+  int             count;
+  bool            closed;
+  pthread_mutex_t lock;
+  pthread_cond_t  not_empty;
+  pthread_cond_t  not_full;
+} batch_queue;
+
+void initQueue(batch_queue *queue, int capacity){
+	queue->items = (batch **)malloc(sizeof(batch *)*capacity);
+	queue->capacity = capacity;
+	queue->head = 0;
+	queue->count = 0;
+	queue->closed = false;
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->not_empty, NULL);
+	pthread_cond_init(&queue->not_full, NULL);
+}
 
-	FILE *outfile = fopen(argv[2], "w+");
-	
+void pushQueue(batch_queue *queue, batch *item){
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count == queue->capacity)
+		pthread_cond_wait(&queue->not_full, &queue->lock);
+	queue->items[(queue->head + queue->count) % queue->capacity] = item;
+	queue->count++;
+	pthread_cond_signal(&queue->not_empty);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+batch *popQueue(batch_queue *queue){
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count == 0 && !queue->closed)
+		pthread_cond_wait(&queue->not_empty, &queue->lock);
+	batch *item = NULL;
+	if (queue->count > 0){
+		item = queue->items[queue->head];
+		queue->head = (queue->head + 1) % queue->capacity;
+		queue->count--;
+		pthread_cond_signal(&queue->not_full);
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return item;
+}
 
-	int holder;
-	long long time_elapsed = 0;
-	int count = 0;
-	int inwards = 0;
-	long long total_pre_compress = 0;
-	long long total_post_compress = 0;
+void closeQueue(batch_queue *queue){
+	pthread_mutex_lock(&queue->lock);
+	queue->closed = true;
+	pthread_cond_broadcast(&queue->not_empty);
+	pthread_mutex_unlock(&queue->lock);
+}
 
-	page_info current_page;
-	long long current_time = 0;
-	int numLarge = 0;
+// shared, read-only once the threads start
+unsigned long long unit_size;
+unsigned long long pages_per_unit;
+int num_codecs;
+codec_column codecs[RESULTS_MAX_CODECS];
+bool any_ring = false;
+int pool_size;
+bool batch_timing = false;   // -B
+bool pin_workers = false;    // -p
+bool check_estimates = false; // -e
+bool sizes_only = false;     // -z
+long long cache_pages = 0;   // -m
+result_cache cache;
+trace_map map;
+
+batch_queue free_batches;   // empty, ready for the reader
+batch_queue work_batches;   // read, waiting for a worker
+batch_queue done_batches;   // compressed, waiting for the writer
+
+// writer totals
+FILE *outfile;
+int count = 0;
+int inwards = 0;
+int numLarge = 0;
+long long total_pre_compress = 0;
+long long total_post_compress[RESULTS_MAX_CODECS];
+long long time_elapsed[RESULTS_MAX_CODECS];
+long long estimate_error[RESULTS_MAX_CODECS];       // sum of predicted less actual sizes
+long long estimate_abs_error[RESULTS_MAX_CODECS];
+long long estimate_time = 0;
+long long estimated = 0;    // records with estimates, i.e. those of this run
+
+// Per-thread state of a worker: its own codecs and output buffers
+typedef struct {
+  CompressionAlgo *algos[RESULTS_MAX_CODECS];
+  WK_word         *dest_area;    // BATCH_PAGES slots of 2 pages each
+  WK_word         *udest_area;   // BATCH_PAGES pages
+  WK_word         *copy_area;    // BATCH_PAGES pages, aligned copies of unaligned input
+  WK_word         *ring;         // CACHE_RING_BYTES of output slots for ring columns
+  int             ring_slots;
+  int             next_slot;
+  // with -m, the pages of a run that missed in the cache
+  codec_result    *page_results; // BATCH_PAGES rows of num_codecs results
+  codec_result    *unit_rows[BATCH_PAGES];
+  uint64_t        hashes[BATCH_PAGES][2];
+} worker_state;
+
+// The page'th page of a batch, counting through all of its units. Records of
+// timestamped traces have variable-length heads, which can leave the contents
+// unaligned for the codecs' word accesses; those pages are copied to slot.
+WK_word *batchPage(batch *work, unsigned long long page, WK_word *slot){
+	const char *contents = (const char *)work->units[page/pages_per_unit] + (page%pages_per_unit)*PAGE_SIZE;
+	if ((uintptr_t)contents % sizeof(WK_word) != 0){
+		memcpy(slot, contents, PAGE_SIZE);
+		return slot;
+	}
+	return (WK_word *)contents;
+}
+
+// Serves the pages of a run found in the cache, adding their results to their
+// units, and packs the others to the front of the run, each with its own row
+// of results to be cached. Returns the number left to compress.
+int serveFromCache(worker_state *state, page_run *run){
+	int misses = 0;
+	for (int k = 0; k < run->count; k++){
+		uint64_t hash[2];
+		codec_result *unit = run->results[k];
+		codec_result *row = state->page_results + misses*num_codecs;
+		result_cache_hash((const uint64_t *)run->srcs[k], PAGE_SIZE/sizeof(uint64_t), hash);
+		if (result_cache_lookup(&cache, hash, row)){
+			for (int c = 0; c < num_codecs; c++){
+				unit[c].comp_size += row[c].comp_size;
+				unit[c].comp_time += row[c].comp_time;
+				unit[c].decomp_time += row[c].decomp_time;
+			}
+			continue;
+		}
+		memset(row, 0, sizeof(codec_result)*num_codecs);
+		run->srcs[misses] = run->srcs[k];
+		run->results[misses] = row;
+		state->unit_rows[misses] = unit;
+		state->hashes[misses][0] = hash[0];
+		state->hashes[misses][1] = hash[1];
+		misses++;
+	}
+	return misses;
+}
 
-	fread(addr, sizeof(WK_word), 1, infile);
-	current_page.address = *addr;
-	while ((holder = fread(src_buf, sizeof(WK_word), WORDS_PER_PAGE, infile)) == WORDS_PER_PAGE){
+// Caches the results of the pages serveFromCache() left, and adds them to their units.
+void cacheResults(worker_state *state, page_run *run){
+	for (int k = 0; k < run->count; k++){
+		result_cache_insert(&cache, state->hashes[k], run->results[k]);
+		for (int c = 0; c < num_codecs; c++){
+			state->unit_rows[k][c].comp_size += run->results[k][c].comp_size;
+			state->unit_rows[k][c].comp_time += run->results[k][c].comp_time;
+			state->unit_rows[k][c].decomp_time += run->results[k][c].decomp_time;
+		}
+	}
+}
 
+// Compresses whole batches, BATCH_PAGES pages at a time. Each codec in turn
+// works through those pages, which stay in cache between codecs. Times are
+// per-thread CPU time, so they do not include time spent waiting on other
+// threads.
+void *compressWorker(void *arg){
+	if (pin_workers){
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET((long)arg % sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	}
 
-        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start_time);
-        dest_end = test.compress(src_buf, dest_buf, WORDS_PER_PAGE);
-        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end_time);
-        total_time = diff(start_time, end_time);
-        current_time = total_time.tv_sec*1000000000 + total_time.tv_nsec;
-        size = ((char *)dest_end - (char *)dest_buf);
+	worker_state state;
+	for (int c = 0; c < num_codecs; c++)
+		state.algos[c] = codecs[c].codec->create();
+	state.dest_area = (WK_word*)malloc(PAGE_SIZE*2*BATCH_PAGES);
+	state.udest_area = (WK_word*)malloc(PAGE_SIZE*BATCH_PAGES);
+	state.copy_area = (WK_word*)malloc(PAGE_SIZE*BATCH_PAGES);
+	state.ring = NULL;
+	state.ring_slots = CACHE_RING_BYTES/(PAGE_SIZE*3*BATCH_PAGES);
+	state.next_slot = 0;
+	if (any_ring)
+		state.ring = (WK_word*)malloc((size_t)state.ring_slots*PAGE_SIZE*3*BATCH_PAGES);
+	state.page_results = (codec_result *)malloc(sizeof(codec_result)*BATCH_PAGES*num_codecs);
+
+	WK_word *srcs[BATCH_PAGES];
+	codec_result *results[BATCH_PAGES];
+	page_run run;
+	run.srcs = srcs;
+	run.results = results;
+
+	batch *work;
+	while ((work = popQueue(&work_batches)) != NULL){
+		memset(work->results, 0, sizeof(codec_result)*work->count*num_codecs);
+		if (check_estimates){
+			memset(work->estimates, 0, sizeof(page_estimate)*work->count);
+			work->estimate_time = 0;
+		}
 
-		current_page.comp_size = size;
-		current_page.comp_time = current_time;
+		unsigned long long total_pages = work->count*pages_per_unit;
+		for (unsigned long long first = 0; first < total_pages; first += BATCH_PAGES){
+			run.count = total_pages - first < BATCH_PAGES ? total_pages - first : BATCH_PAGES;
+			for (int k = 0; k < run.count; k++){
+				srcs[k] = batchPage(work, first + k, state.copy_area + k*WORDS_PER_PAGE);
+				results[k] = work->results + ((first + k)/pages_per_unit)*num_codecs;
+			}
+			if (check_estimates){
+				uint64_t start = timing_start(&timer);
+				for (int k = 0; k < run.count; k++){
+					page_estimate *unit = &work->estimates[(first + k)/pages_per_unit];
+					page_estimate page;
+					estimate_page(srcs[k], WORDS_PER_PAGE, &page);
+					for (int kind = 0; kind < ESTIMATE_KINDS; kind++)
+						unit->size[kind] += page.size[kind];
+				}
+				work->estimate_time += (long long)(((int64_t)(timing_stop(&timer) - start) - timer.overhead)*timer.ns_per_tick);
+			}
+			if (cache_pages > 0)
+				run.count = serveFromCache(&state, &run);
+			for (int c = 0; c < num_codecs; c++){
+				run.column = c;
+				run.cache = codecs[c].cache;
+				run.dest_area = state.dest_area;
+				run.udest_area = state.udest_area;
+				if (run.cache == CACHE_RING){
+					// each run writes to the slot least recently used
+					run.dest_area = state.ring + (size_t)state.next_slot*3*BATCH_PAGES*WORDS_PER_PAGE;
+					run.udest_area = run.dest_area + 2*BATCH_PAGES*WORDS_PER_PAGE;
+					state.next_slot = (state.next_slot + 1) % state.ring_slots;
+				}
+				if (sizes_only)
+					codecs[c].codec->sizeEachPage(state.algos[c], codecs[c].name, &run);
+				else if (batch_timing)
+					codecs[c].codec->timeWholeRun(state.algos[c], codecs[c].name, &run);
+				else
+					codecs[c].codec->timeEachPage(state.algos[c], codecs[c].name, &run);
+			}
+			if (cache_pages > 0)
+				cacheResults(&state, &run);
+		}
+		pushQueue(&done_batches, work);
+	}
 
-		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start_time);
-		udest_end = test.decompress(dest_buf, udest_buf, size);
-		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end_time);
-		total_time = diff(start_time, end_time);
-		current_time = total_time.tv_sec*1000000000 + total_time.tv_nsec;
+	for (int c = 0; c < num_codecs; c++)
+		delete state.algos[c];
+	free(state.dest_area);
+	free(state.udest_area);
+	free(state.copy_area);
+	free(state.ring);
+	free(state.page_results);
+	return NULL;
+}
 
-		current_page.decomp_time = current_time;
+// Adds a record to the totals reported at the end.
+void countRecord(const page_record *record, const codec_result *results){
+	total_pre_compress += unit_size;
+	for (int c = 0; c < num_codecs; c++){
+		total_post_compress[c] += results[c].comp_size;
+		time_elapsed[c] += results[c].comp_time + results[c].decomp_time;
+	}
 
-		fwrite(&current_page, sizeof(page_info), 1, outfile);
+	WK_word address = record->address;
+	count++;
+	if (address > 0xffffffff){
+	  // printf("*****Large addr: %lu******\n", address);
+	  numLarge++;
+	}
+	//printf("%p\n", (void *)address);
+	if ((address | 0x8000000000000000) == address) inwards++;
+}
 
-		count++;
-		fread(addr, sizeof(WK_word), 1, infile);
-		current_page.address = *addr;
-		if (*addr > 0xffffffff){
-		  // printf("*****Large addr: %lu******\n", *addr);
-		  numLarge++;
+// Writes batches in trace order. At most pool_size batches are in flight, so
+// seq % pool_size is a free slot while a batch waits for its predecessors.
+void *orderedWriter(void *arg){
+	batch **waiting = (batch **)calloc(pool_size, sizeof(batch *));
+	long long next = 0;
+
+	batch *done;
+	while ((done = popQueue(&done_batches)) != NULL){
+		waiting[done->seq % pool_size] = done;
+
+		while ((done = waiting[next % pool_size]) != NULL && done->seq == next){
+			waiting[next % pool_size] = NULL;
+			for (int u = 0; u < done->count; u++){
+				codec_result *results = done->results + u*num_codecs;
+				fwrite(&done->records[u], sizeof(page_record), 1, outfile);
+				fwrite(results, sizeof(codec_result), num_codecs, outfile);
+				countRecord(&done->records[u], results);
+
+				if (check_estimates){
+					for (int c = 0; c < num_codecs; c++){
+						int kind = codecs[c].codec->estimate;
+						if (kind == ESTIMATE_NONE)
+							continue;
+						long long error = (long long)done->estimates[u].size[kind] - results[c].comp_size;
+						estimate_error[c] += error;
+						estimate_abs_error[c] += error < 0 ? -error : error;
+					}
+					estimated++;
+				}
+			}
+			estimate_time += done->estimate_time;
+			next++;
+			// nothing points into the trace before this batch's end any more
+			trace_map_release(&map, done->end);
+			pushQueue(&free_batches, done);
 		}
-		//printf("%p   %p\n", (void *)*addr, (void *)current_page.address);
-		if ((*addr | 0x8000000000000000) == *addr) inwards++;
 	}
 
-	
+	free(waiting);
+	return NULL;
+}
+// Reopens the results of a stopped run for appending: checks that they hold the
+// same unit size and codecs, drops a partly written last record and adds the
+// records already there to the totals. Returns the number of records kept, -1
+// if there are no results yet, or -2 if they cannot be resumed.
+long long resumeResults(const char *path, const results_codecs *table){
+	outfile = fopen(path, "r+");
+	if (outfile == NULL)
+		return -1;
+	trace_header old_header;
+	results_codecs old_table;
+	if (trace_read_header(outfile, RESULTS_MAGIC, &old_header) != 0 || old_header.version != TRACE_VERSION ||
+	    old_header.granularity != unit_size || fread(&old_table, sizeof(results_codecs), 1, outfile) != 1 ||
+	    memcmp(&old_table, table, sizeof(results_codecs)) != 0)
+		return -2;
+
+	size_t record_size = sizeof(page_record) + sizeof(codec_result)*num_codecs;
+	char *record = (char *)malloc(record_size);
+	long long records = 0;
+	while (fread(record, record_size, 1, outfile) == 1){
+		countRecord((const page_record *)record, (const codec_result *)(record + sizeof(page_record)));
+		records++;
+	}
+	free(record);
+
+	long end = sizeof(trace_header) + sizeof(results_codecs) + records*record_size;
+	if (fseek(outfile, end, SEEK_SET) != 0 || ftruncate(fileno(outfile), end) != 0)
+		return -2;
+	return records;
+}
+
+
+int main(int argc, char *argv[]){
+
+	char *codec_list = NULL;
+	long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int timer_source = TIMING_CLOCK;
+	int repeats = 1;
+	int statistic = TIMING_MIN;
+	int default_cache = CACHE_WARM;
+	long long start_chunk = 0;
+	long long end_chunk = -1;
+	bool resume = false;
+	static struct option long_options[] = {
+		{"start-chunk", required_argument, NULL, 'S'},
+		{"end-chunk",   required_argument, NULL, 'E'},
+		{"resume",      no_argument,       NULL, 'R'},
+		{NULL, 0, NULL, 0}
+	};
+	int opt;
+	while ((opt = getopt_long(argc, argv, "c:j:Bt:r:s:pC:em:z", long_options, NULL)) != -1){
+		switch (opt){
+		case 'S':
+			start_chunk = strtoll(optarg, NULL, 10);
+			if (start_chunk < 0)
+				num_threads = 0;
+			break;
+		case 'E':
+			end_chunk = strtoll(optarg, NULL, 10);
+			if (end_chunk < 0)
+				num_threads = 0;
+			break;
+		case 'R':
+			resume = true;
+			break;
+		case 'C':
+			default_cache = findCacheMode(optarg);
+			if (default_cache < 0)
+				num_threads = 0;
+			break;
+		case 'B':
+			batch_timing = true;
+			break;
+		case 't':
+			if (strcmp(optarg, "tsc") == 0)
+				timer_source = TIMING_TSC;
+			else if (strcmp(optarg, "clock") != 0)
+				num_threads = 0;
+			break;
+		case 'r':
+			repeats = strtol(optarg, NULL, 10);
+			if (repeats < 1 || repeats > TIMING_MAX_REPEATS)
+				num_threads = 0;
+			break;
+		case 's':
+			if (strcmp(optarg, "median") == 0)
+				statistic = TIMING_MEDIAN;
+			else if (strcmp(optarg, "min") != 0)
+				num_threads = 0;
+			break;
+		case 'p':
+			pin_workers = true;
+			break;
+		case 'e':
+			check_estimates = true;
+			break;
+		case 'z':
+			sizes_only = true;
+			break;
+		case 'm':
+			cache_pages = strtoll(optarg, NULL, 10);
+			if (cache_pages <= 0)
+				num_threads = 0;
+			break;
+		case 'c':
+			codec_list = optarg;
+			break;
+		case 'j':
+			num_threads = strtol(optarg, NULL, 10);
+			break;
+		default:
+			num_threads = 0;
+		}
+	}
+	if (argc - optind != 2 || num_threads <= 0){
+		printf("Invalid use of command. Include one input file and one output file, optionally preceded by -c and a list of codecs, -j and a number of threads, -B for batch timing, -t clock|tsc, -r and a number of repeats, -s min|median, -p to pin threads, -C warm|cold|ring, -e to check size estimates, -m and a number of pages to cache results for, -z to record sizes only, --start-chunk and --end-chunk and a chunk of the trace, and --resume.\n");
+		return -1;
+	}
+	if (timing_init(&timer, timer_source, repeats, statistic) != 0){
+		printf("The time stamp counter is not available on this machine.\n");
+		return -1;
+	}
+	estimate_init();
+
+	num_codecs = selectCodecs(codec_list, default_cache, codecs);
+	if (num_codecs <= 0){
+		printf("Available codecs, each optionally followed by :warm, :cold or :ring:");
+		for (int i = 0; i < NUM_REGISTERED; i++)
+			printf(" %s", codec_registry[i].name);
+		printf("\nWK variants, all of them as wk*:");
+		for (int i = 0; i < WK_NUM_VARIANTS; i++)
+			printf(" %s", wk_variant_registry[i].name);
+		printf("\n");
+		return -1;
+	}
+	for (int c = 0; c < num_codecs; c++){
+		any_ring = any_ring || codecs[c].cache == CACHE_RING;
+#ifndef TIMING_HAVE_TSC
+		if (codecs[c].cache == CACHE_COLD){
+			printf("Cold timing needs CLFLUSH, which this machine lacks; use ring instead.\n");
+			return -1;
+		}
+#endif
+	}
+
+	if (cache_pages > 0 && result_cache_init(&cache, cache_pages, sizeof(codec_result)*num_codecs) != 0){
+		printf("Unable to allocate a cache of %lld pages.\n", cache_pages);
+		return -1;
+	}
+
+	FILE *infile = fopen(argv[optind], "r");
+	if(infile == NULL){
+		printf("Invalid file name.\n");
+		return -2;
+	}
+
+	// Each record holds one tracking unit, which may span several pages (e.g. 2 MB
+	// huge pages). Units are compressed a page at a time and reported as a whole.
+	trace_header header;
+	if (trace_read_header(infile, TRACE_MAGIC, &header) != 0 || header.granularity % PAGE_SIZE != 0){
+		printf("Unsupported trace header.\n");
+		return -3;
+	}
+	unit_size = header.granularity;
+	pages_per_unit = unit_size/PAGE_SIZE;
+
+	// read the records through a mapping of the rest of the file
+	long data_offset = ftell(infile);
+	if (trace_map_open(&map, argv[optind], data_offset, TRACE_MAP_DEFAULT_WINDOW) != 0){
+		printf("Unable to map %s.\n", argv[optind]);
+		return -2;
+	}
 	fclose(infile);
-	printf("****************Leftover bytes: %d  Number of pages: %d  Number inwards: %d   Number large: %d****************\n", holder, count, inwards, numLarge);
-	printf("WK Compression and Decompression took: %lld seconds and %lld nanoseconds\n", (long long)time_elapsed/1000000000, (long long)time_elapsed%1000000000);
-	printf("WK Compressed %lld bytes into %lld bytes for a percentage compressed of: %f\n", total_pre_compress, total_post_compress, 1-((double)total_post_compress/total_pre_compress));
+	trace_map_prefetch(&map, map.pos);
+
+	results_codecs table;
+	memset(&table, 0, sizeof(table));
+	table.num_codecs = num_codecs;
+	for (int i = 0; i < num_codecs; i++)
+		strncpy(table.names[i], codecs[i].name, RESULTS_CODEC_NAME_LEN);
+
+	long long resumed = resume ? resumeResults(argv[optind + 1], &table) : -1;
+	if (resumed == -2){
+		printf("%s does not hold results for this trace and these codecs, so it cannot be resumed.\n", argv[optind + 1]);
+		return -2;
+	}
+	if (resumed == -1){
+		resumed = 0;
+		outfile = fopen(argv[optind + 1], "w+");
+		trace_header out_header;
+		trace_init_header(&out_header, RESULTS_MAGIC, unit_size);
+		out_header.flags = header.flags & TRACE_FLAG_TIMESTAMPS;
+		out_header.start_ns = header.start_ns;
+		fwrite(&out_header, sizeof(trace_header), 1, outfile);
+		fwrite(&table, sizeof(results_codecs), 1, outfile);
+	}
+
+	// the records to compress: those of the chunks asked for, less any already done
+	uint64_t next_record = start_chunk*TRACE_INDEX_CHUNK + resumed;
+	uint64_t end_record = end_chunk < 0 ? UINT64_MAX : end_chunk*TRACE_INDEX_CHUNK;
+	trace_clock clock;
+	trace_clock_init(&clock, &header);
+	bool more = next_record < end_record;
+	if (more && next_record > 0){
+		trace_index index;
+		if (trace_index_open(&index, argv[optind], &header, data_offset) != 0){
+			printf("Unable to index %s.\n", argv[optind]);
+			return -2;
+		}
+		more = trace_index_seek(&index, next_record, &map, &header, &clock) == 0;
+		trace_index_free(&index);
+	}
+
+	// two batches per worker keep every worker busy while the reader and the
+	// writer each hold one more
+	pool_size = 2*num_threads + 2;
+	initQueue(&free_batches, pool_size);
+	initQueue(&work_batches, pool_size);
+	initQueue(&done_batches, pool_size);
+	for (int i = 0; i < pool_size; i++){
+		batch *empty = (batch *)malloc(sizeof(batch));
+		empty->records = (page_record *)malloc(sizeof(page_record)*BATCH_UNITS);
+		empty->units = (const WK_word **)malloc(sizeof(WK_word *)*BATCH_UNITS);
+		empty->results = (codec_result *)malloc(sizeof(codec_result)*BATCH_UNITS*num_codecs);
+		empty->estimates = (page_estimate *)malloc(sizeof(page_estimate)*BATCH_UNITS);
+		pushQueue(&free_batches, empty);
+	}
+
+	pthread_t writer;
+	pthread_t *workers = (pthread_t *)malloc(sizeof(pthread_t)*num_threads);
+	pthread_create(&writer, NULL, orderedWriter, NULL);
+	for (long i = 0; i < num_threads; i++)
+		pthread_create(&workers[i], NULL, compressWorker, (void *)i);
+
+	long long seq = 0;
+	uint64_t address;
+	uint64_t time_ns;
+	uint32_t tid;
+
+	while (more){
+		batch *fill = popQueue(&free_batches);
+		fill->seq = seq++;
+		fill->count = 0;
+		while (fill->count < BATCH_UNITS){
+			const WK_word *unit;
+			if (next_record == end_record ||
+			    trace_map_record_head(&map, &header, &clock, &address, &time_ns, &tid) != 0 ||
+			    (unit = (const WK_word *)trace_map_get(&map, unit_size)) == NULL){
+				more = false;
+				break;
+			}
+			fill->units[fill->count] = unit;
+			fill->records[fill->count].address = address;
+			fill->records[fill->count].timestamp = time_ns;
+			fill->records[fill->count].tid = tid;
+			fill->records[fill->count].reserved = 0;
+			fill->count++;
+			next_record++;
+		}
+		fill->end = map.pos;
+		pushQueue(&work_batches, fill);
+	}
+
+	closeQueue(&work_batches);
+	for (long i = 0; i < num_threads; i++)
+		pthread_join(workers[i], NULL);
+	closeQueue(&done_batches);
+	pthread_join(writer, NULL);
+
+	int holder = map.size - map.pos;
+	trace_map_close(&map);
+	fclose(outfile);
+	printf("****************Leftover bytes: %d  Number of pages: %d  Number inwards: %d   Number large: %d  Unit size: %llu****************\n", holder, count, inwards, numLarge, unit_size);
+	for (int c = 0; c < num_codecs; c++){
+		printf("%s Compression and Decompression took: %lld seconds and %lld nanoseconds\n", codecs[c].name, time_elapsed[c]/1000000000, time_elapsed[c]%1000000000);
+		printf("%s Compressed %lld bytes into %lld bytes for a percentage compressed of: %f\n", codecs[c].name, total_pre_compress, total_post_compress[c], 1-((double)total_post_compress[c]/total_pre_compress));
+	}
+	if (check_estimates && estimated > 0){
+		for (int c = 0; c < num_codecs; c++)
+			if (codecs[c].codec->estimate != ESTIMATE_NONE)
+				printf("%s Size estimates were off by %f bytes per record on average (%f%% of its compressed size), biased by %+f bytes\n", codecs[c].name,
+				       (double)estimate_abs_error[c]/estimated, total_post_compress[c] > 0 ? 100.0*estimate_abs_error[c]/total_post_compress[c] : 0.0,
+				       (double)estimate_error[c]/estimated);
+		printf("Estimating took %f ns per page\n", (double)estimate_time/(estimated*pages_per_unit));
+	}
+	if (cache_pages > 0){
+		long long lookups, hits;
+		result_cache_stats(&cache, &lookups, &hits);
+		printf("Served %lld of %lld pages (%f%%) from the cache of %lld pages\n", hits, lookups, lookups > 0 ? 100.0*hits/lookups : 0.0, cache_pages);
+		result_cache_free(&cache);
+	}
+	printf("Timed with %s at %f ns per tick, less %lld ticks of overhead, %s of %d runs per call\n", timer.source == TIMING_TSC ? "the TSC" : "the thread CPU clock",
+	       timer.ns_per_tick, (long long)timer.overhead, timer.statistic == TIMING_MEDIAN ? "median" : "minimum", timer.repeats);
 	printf("Size of WK_word: %lu     Size of uintptr_t:   %lu     Size of void*: %lu\n", sizeof(WK_word), sizeof(uintptr_t), sizeof(void*));
 }
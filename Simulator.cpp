@@ -4,8 +4,12 @@
 #include <stdlib.h>
 #include <string>
 #include <math.h>
-#include "framework.hpp"
+#include <getopt.h>
+#include "results.h"
 #include "Allocator.h"
+#include "trace.h"
+#include "trace_map.h"
+#include "trace_index.h"
 
 extern "C" {
 	#include "WK.h" 
@@ -17,6 +21,11 @@ extern "C" {
 //ratio of hits to pre-fetching since last dump
 //what-if on multiples 
 
+//usage: Simulator [--start-chunk A] [--end-chunk B] [--checkpoint] [--resume] results mem queue multiple [codec]
+//--start-chunk and --end-chunk simulate only chunks [A, B) of the results, TRACE_INDEX_CHUNK records
+//each, starting from an empty memory. --checkpoint saves the whole state of the simulation to
+//results.ckpt after every chunk, and --resume continues from there with the same arguments.
+
 //g++ -O1 -fthread-jumps -falign-functions -falign-loops -falign-jumps -falign-labels -fcaller-saves -fcrossjumping -fcse-follow-jumps -fcse-skip-blocks -fdelete-null-pointer-checks -fdevirtualize -fexpensive-optimizations -fgcse -finline-small-functions -findirect-inlining -fipa-cp -foptimize-sibling-calls -foptimize-strlen -fpartial-inlining -fpeephole2 -freorder-blocks-and-partition -freorder-functions -frerun-cse-after-loop -fsched-interblock -fsched-spec -fschedule-insns -fschedule-insns2 -fstrict-aliasing -fstrict-overflow -ftree-builtin-call-dce -ftree-switch-conversion -ftree-tail-merge -ftree-pre Simulator.cpp -o Simulator
 
 
@@ -27,14 +36,16 @@ const long long ssd_time = 100000; //in ns
 //const double multiple = 2.0;
 const int pages_per_fetch = 128;
 const int pre_fetch_queue_length = 3;
-const int pre_fetch_size = 4096*pages_per_fetch*pre_fetch_queue_length; //page_size*number
 // use array to define different compression levels
 const double comp_perc_level[] = {0.0, .10, .20, .30, .40, .50, .60, .70, .80, .90, 1.0};
 page_info fetched[num_cache][pre_fetch_queue_length][pages_per_fetch];
 const double alpha = .99;
 
-// determined from command line inputs
+// determined from command line inputs and the trace header
 FILE *file;
+trace_map map;     // the records of file, read in place
+long long unit_size;                // bytes per tracked unit, 4096 unless traced at huge-page granularity
+long long pre_fetch_size;           // unit_size*number
 long long mem_size;// = 20971520*3; // 20MB*3 of RAM
 int queue_size;// = 2000;           // number of pages
 long long trace_mem_size;
@@ -52,9 +63,56 @@ double locality = 0;
 int temp_pre_possible[num_cache];
 int temp_pre_hits[num_cache];
 
+// stall modeling, only for traces with timestamps: each configuration's swap
+// path is busy until the given time, and faults arriving earlier wait for it
+int timed = 0;
+int results_version;
+
+// results files from version 4 on hold a column per codec; the simulation
+// uses the one chosen on the command line
+results_codecs codec_table;
+int codec_column = 0;
+long long busy_until[num_cache];
+long long ssd_busy_until[num_cache];
+long long stall_times[num_cache];
+long long ssd_stall_times[num_cache];
+
 page_info *queueF;// = (page_info *)malloc(sizeof(page_info)*25000);
 int queueB = 0; //max index into queue + 1
 
+// use array to store total swap times
+long long total_times[num_cache];
+long long ssd_total_times[num_cache];
+long long noPar_total_times[num_cache];
+long long noPar_ssd_total_times[num_cache];
+long long comp_times[num_cache];
+long long comp_decomp = 0;
+long long comp_count = 0;
+long long unseen = 0;   // pages coming back that left before the first record simulated
+
+// everything a checkpoint saves, besides queueF[0..queueB)
+#define SIMULATOR_STATE(X) \
+  X(perc_size_post_comp) X(count) X(mem_used) X(pre_fetch_front) X(num_fetch_hits) X(num_fetch_possible) \
+  X(prefetch_hit_rates) X(locality) X(temp_pre_possible) X(temp_pre_hits) X(busy_until) X(ssd_busy_until) \
+  X(stall_times) X(ssd_stall_times) X(fetched) X(queueB) X(total_times) X(ssd_total_times) X(noPar_total_times) \
+  X(noPar_ssd_total_times) X(comp_times) X(comp_decomp) X(comp_count) X(unseen)
+
+#define CHECKPOINT_MAGIC   0x54504b4354504d49ULL   // "IMPTCKPT"
+#define CHECKPOINT_VERSION 1
+
+// what a checkpoint was taken of: it only resumes the same simulation
+typedef struct {
+  uint64_t  magic;
+  uint32_t  version;
+  int32_t   codec_column;
+  uint64_t  results_size;
+  long long mem_size;
+  long long queue_size;
+  double    multiple;
+  uint64_t  first_record;     // where the simulation began
+  uint64_t  next_record;      // first record not yet simulated
+} checkpoint_header;
+
 //updated
 void pushBackQueue(page_info move, int index){
   if (index == -1 && (queueB+1)>=500000) printf("END OF QUEUE REACHED****\n");
@@ -71,10 +129,97 @@ void pushBackQueue(page_info move, int index){
   queueF[0] = holder;
 }
 
+// reads the next page of the results file, whichever version wrote it
+int readPage(page_info *page){
+  // each page is read once, so the file behind it can go
+  trace_map_release(&map, map.pos);
+
+  if (results_version >= 4){
+    const page_record *record = (const page_record *)trace_map_get(&map, sizeof(page_record));
+    const codec_result *results = (const codec_result *)trace_map_get(&map, sizeof(codec_result)*codec_table.num_codecs);
+    if (record == NULL || results == NULL)
+      return 0;
+    page->address = record->address;
+    page->comp_size = results[codec_column].comp_size;
+    page->comp_time = results[codec_column].comp_time;
+    page->decomp_time = results[codec_column].decomp_time;
+    page->timestamp = record->timestamp;
+    page->tid = record->tid;
+    return 1;
+  }
+  if (results_version >= 3){
+    const page_info *current = (const page_info *)trace_map_get(&map, sizeof(page_info));
+    if (current == NULL)
+      return 0;
+    *page = *current;
+    return 1;
+  }
+
+  const page_info_v2 *old_page = (const page_info_v2 *)trace_map_get(&map, sizeof(page_info_v2));
+  if (old_page == NULL)
+    return 0;
+  page->address = old_page->address;
+  page->comp_size = old_page->comp_size;
+  page->comp_time = old_page->comp_time;
+  page->decomp_time = old_page->decomp_time;
+  page->timestamp = 0;
+  page->tid = 0;
+  return 1;
+}
+
+// Saves the simulation to path, through a temporary file so that a crash while
+// saving leaves the previous checkpoint intact
+int saveCheckpoint(const char *path, checkpoint_header *ckpt){
+  std::string temp = std::string(path) + ".tmp";
+  FILE *out = fopen(temp.c_str(), "w");
+  if (out == NULL)
+    return -1;
+  int ok = fwrite(ckpt, sizeof(checkpoint_header), 1, out) == 1;
+#define SAVE_STATE(var) ok = ok && fwrite(&var, sizeof(var), 1, out) == 1;
+  SIMULATOR_STATE(SAVE_STATE)
+#undef SAVE_STATE
+  ok = ok && fwrite(queueF, sizeof(page_info), queueB, out) == (size_t)queueB;
+  if (fclose(out) != 0 || !ok)
+    return -1;
+  return rename(temp.c_str(), path);
+}
+
+// Restores a simulation saved by saveCheckpoint(), provided it was taken of
+// the simulation described by expected
+int loadCheckpoint(const char *path, checkpoint_header *expected){
+  FILE *in = fopen(path, "r");
+  if (in == NULL)
+    return -1;
+  checkpoint_header ckpt;
+  int ok = fread(&ckpt, sizeof(checkpoint_header), 1, in) == 1 && ckpt.magic == CHECKPOINT_MAGIC &&
+           ckpt.version == CHECKPOINT_VERSION && ckpt.codec_column == expected->codec_column &&
+           ckpt.results_size == expected->results_size && ckpt.mem_size == expected->mem_size &&
+           ckpt.queue_size == expected->queue_size && ckpt.multiple == expected->multiple &&
+           ckpt.first_record == expected->first_record;
+#define LOAD_STATE(var) ok = ok && fread(&var, sizeof(var), 1, in) == 1;
+  SIMULATOR_STATE(LOAD_STATE)
+#undef LOAD_STATE
+  ok = ok && queueB >= 0 && queueB <= 500000 && fread(queueF, sizeof(page_info), queueB, in) == (size_t)queueB;
+  fclose(in);
+  if (!ok)
+    return -1;
+  expected->next_record = ckpt.next_record;
+  return 0;
+}
+
+// A fault at time now is served once the swap path is free and takes latency ns,
+// during which the faulting thread stalls. Background work (recompressing the
+// page) follows on the swap path but only delays later faults.
+void addStall(long long now, long long latency, long long background, long long *busy, long long *stall){
+  long long start = (*busy > now) ? *busy : now;
+  *stall += start + latency - now;
+  *busy = start + latency + background;
+}
+
 //updated
 unsigned int searchQueue(WK_word address){
   unsigned int count = 0;
-  while(count < queueB && count<=(mem_used/4096)){
+  while(count < queueB && count<=(mem_used/unit_size)){
     if((((queueF[count].address)<<1)>>1) == address)
       return count;
     count++;
@@ -103,15 +248,15 @@ void preFetch(int index, int comp_level){
   // front and back are the number elements around the index to prefetch
   int front = 0;
   int i = pages_per_fetch/2;
-  while((index+queue_size-front-1 > (int)((mem_size/4096)*(1-comp_perc_level[comp_level]))) && i > 0 && (index-front-1)>0){
+  while((index+queue_size-front-1 > (int)((mem_size/unit_size)*(1-comp_perc_level[comp_level]))) && i > 0 && (index-front-1)>0){
     front++;
     i--;
   }
   //printf("front: %d\n", front);
   int back = 0;
   int j = pages_per_fetch-front;
-  while((index+queue_size+back+1 <= (int)((mem_size/4096)*(1-comp_perc_level[comp_level]))
-    +(comp_perc_level[comp_level]*mem_size/(perc_size_post_comp*4096))) && j > 0){
+  while((index+queue_size+back+1 <= (int)((mem_size/unit_size)*(1-comp_perc_level[comp_level]))
+    +(comp_perc_level[comp_level]*mem_size/(perc_size_post_comp*unit_size))) && j > 0){
     back++;
     j--;
   }
@@ -190,9 +335,46 @@ void preFetch(int index, int comp_level){
 
 int main(int argc, char *argv[]){
   
+  long long start_chunk = 0;
+  long long end_chunk = -1;
+  bool checkpoint = false;
+  bool resume = false;
+  static struct option long_options[] = {
+    {"start-chunk", required_argument, NULL, 'S'},
+    {"end-chunk",   required_argument, NULL, 'E'},
+    {"checkpoint",  no_argument,       NULL, 'K'},
+    {"resume",      no_argument,       NULL, 'R'},
+    {NULL, 0, NULL, 0}
+  };
+  int opt;
+  bool valid = true;
+  while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1){
+    switch (opt){
+    case 'S':
+      start_chunk = strtoll(optarg, NULL, 10);
+      valid = valid && start_chunk >= 0;
+      break;
+    case 'E':
+      end_chunk = strtoll(optarg, NULL, 10);
+      valid = valid && end_chunk >= 0;
+      break;
+    case 'K':
+      checkpoint = true;
+      break;
+    case 'R':
+      resume = true;
+      break;
+    default:
+      valid = false;
+    }
+  }
+  // the positional arguments, from the results file on
+  argc -= optind - 1;
+  argv += optind - 1;
+
   // ensuring proper use
-  if (argc != 5){
-    printf("Invalid use of command. Include one input file, memory size, queue size and multiple.\n");
+  if (!valid || (argc != 5 && argc != 6)){
+    printf("Invalid use of command. Include one input file, memory size, queue size and multiple, optionally followed by a codec, and optionally preceded by --start-chunk and --end-chunk and a chunk, --checkpoint and --resume.\n");
     return -1;
   }
 
@@ -202,12 +384,55 @@ int main(int argc, char *argv[]){
     return -2;
   }
   
+  trace_header header;
+  if (trace_read_header(file, RESULTS_MAGIC, &header) != 0){
+    printf("Unsupported trace header.\n");
+    return -2;
+  }
+  unit_size = header.granularity;
+  results_version = header.version;
+  timed = (header.flags & TRACE_FLAG_TIMESTAMPS) != 0;
+  pre_fetch_size = unit_size*pages_per_fetch*pre_fetch_queue_length;
+
+  // pick the codec to simulate: the one named, else WK, else the first column
+  if (results_version >= 4){
+    if (fread(&codec_table, sizeof(results_codecs), 1, file) != 1 || codec_table.num_codecs == 0 ||
+        codec_table.num_codecs > RESULTS_MAX_CODECS){
+      printf("Unsupported codec table.\n");
+      return -2;
+    }
+    codec_column = results_find_codec(&codec_table, argc == 6 ? argv[5] : "wk");
+    if (codec_column < 0 && argc != 6)
+      codec_column = 0;
+    if (codec_column < 0){
+      printf("%s holds results for:", argv[1]);
+      for (unsigned int i = 0; i < codec_table.num_codecs; i++)
+        printf(" %.*s", RESULTS_CODEC_NAME_LEN, codec_table.names[i]);
+      printf("\n");
+      return -4;
+    }
+  }
+  else if (argc == 6){
+    printf("%s predates per-codec results and holds a single codec.\n", argv[1]);
+    return -4;
+  }
+
+  // the records are read in place from a mapping of the rest of the file
+  long data_offset = ftell(file);
+  if (trace_map_open(&map, argv[1], data_offset, TRACE_MAP_DEFAULT_WINDOW) != 0){
+    printf("Unable to map %s.\n", argv[1]);
+    return -2;
+  }
+  // records have a fixed size, so chunks are found without an index
+  uint64_t record_size = results_version >= 4 ? sizeof(page_record) + sizeof(codec_result)*codec_table.num_codecs :
+                         results_version >= 3 ? sizeof(page_info) : sizeof(page_info_v2);
+
   // account for prefetch and compression hiding
-  mem_size = strtoll(argv[2], NULL, 10) - pre_fetch_size - 4096; 
+  mem_size = strtoll(argv[2], NULL, 10) - pre_fetch_size - unit_size; 
   queue_size = strtol(argv[3], NULL, 10);
-  trace_mem_size = queue_size*4096;
+  trace_mem_size = queue_size*unit_size;
   if (trace_mem_size >= mem_size){
-    printf("Memory size must be greater than QUEUE_SIZE*4096\n");
+    printf("Memory size must be greater than QUEUE_SIZE*%lld\n", unit_size);
     return -3;
   }
 
@@ -227,41 +452,46 @@ int main(int argc, char *argv[]){
   // array of Allocator trackers
   //Allocator *fragmentation = new Allocator[num_cache];
 
-  // use array to store total swap times
-  long long total_times[num_cache];
-  long long ssd_total_times[num_cache];
-  long long noPar_total_times[num_cache];
-  long long noPar_ssd_total_times[num_cache];
-  long long comp_times[num_cache];
-  int clean;
-  for (clean = 0; clean < num_cache; clean++){
-    total_times[clean] = 0;
-    ssd_total_times[clean] = 0;
-    noPar_total_times[clean] = 0;
-    noPar_ssd_total_times[clean] = 0;
-    comp_times[clean] = 0;
-  }
-
   queueF = (page_info *)malloc(sizeof(page_info)*500000);
   if(queueF == NULL)
     printf("MALLOC FAILED!!\n");
 
+  // the records to simulate, from a checkpoint if resuming
+  std::string checkpoint_path = std::string(argv[1]) + ".ckpt";
+  checkpoint_header ckpt;
+  ckpt.magic = CHECKPOINT_MAGIC;
+  ckpt.version = CHECKPOINT_VERSION;
+  ckpt.codec_column = codec_column;
+  ckpt.results_size = map.size;
+  ckpt.mem_size = mem_size;
+  ckpt.queue_size = queue_size;
+  ckpt.multiple = multiple;
+  ckpt.first_record = start_chunk*TRACE_INDEX_CHUNK;
+  ckpt.next_record = ckpt.first_record;
+  if (resume && loadCheckpoint(checkpoint_path.c_str(), &ckpt) != 0){
+    printf("No checkpoint of this simulation in %s.\n", checkpoint_path.c_str());
+    return -2;
+  }
+  uint64_t end_record = end_chunk < 0 ? UINT64_MAX : end_chunk*TRACE_INDEX_CHUNK;
+  if (ckpt.next_record*record_size <= map.size - data_offset)
+    trace_map_seek(&map, data_offset + ckpt.next_record*record_size);
+  else
+    end_record = 0;
+
   long long time_used = 0;
   long long comp10_time_used = 0;
   long long comp100_time_used = 0;
   page_info current_page;
 
-  long long comp_decomp = 0;
-  long long comp_count = 0;
-
 
-  printf("%llu\n", mem_size/4096);
+  printf("%llu\n", mem_size/unit_size);
   
   //actual meat of processing
-  while (fread(&current_page, sizeof(page_info), 1, file) == 1){
+  while (ckpt.next_record < end_record && readPage(&current_page) == 1){
+    ckpt.next_record++;
     //printf("Break 0, ");
     //update the average compression
-    perc_size_post_comp = ((perc_size_post_comp*count) + (((double)current_page.comp_size/multiple)/4096))/(count+1);
+    perc_size_post_comp = ((perc_size_post_comp*count) + (((double)current_page.comp_size/multiple)/unit_size))/(count+1);
     count++;
 
     //printf("1, ");
@@ -280,8 +510,12 @@ int main(int argc, char *argv[]){
 
     if((((current_page.address)<<1)>>1) != current_page.address){
       if (index == -1){
+        // a simulation of a range may see pages come back that left before it began
+        if (ckpt.first_record == 0){
           printf("***ERROR: Page being re-inserted without ever leaving\n");
           return -4;
+        }
+        unseen++;
       }
       
 
@@ -314,11 +548,11 @@ int main(int argc, char *argv[]){
 
 	//printf("4, ");
 
-        while((index+queue_size > (int)((mem_size/4096)*(1-comp_perc_level[i]))) && i >= 0){
+        while((index+queue_size > (int)((mem_size/unit_size)*(1-comp_perc_level[i]))) && i >= 0){
 
 
 	  // =================================== No Prefetch Tracking Section ============================================================
-	  if (index+queue_size <= (int)((mem_size/4096)*(1-comp_perc_level[i]))+(comp_perc_level[i]*mem_size/(perc_size_post_comp*4096))){
+	  if (index+queue_size <= (int)((mem_size/unit_size)*(1-comp_perc_level[i]))+(comp_perc_level[i]*mem_size/(perc_size_post_comp*unit_size))){
 
             noPar_total_times[i] += (current_page.decomp_time + current_page.comp_time);
 	    noPar_ssd_total_times[i] += (current_page.decomp_time + current_page.comp_time);
@@ -341,17 +575,21 @@ int main(int argc, char *argv[]){
           }
 
           // if the page is in the compressed region
-          else if (index+queue_size <= (int)((mem_size/4096)*(1-comp_perc_level[i]))+(comp_perc_level[i]*mem_size/(perc_size_post_comp*4096))){
+          else if (index+queue_size <= (int)((mem_size/unit_size)*(1-comp_perc_level[i]))+(comp_perc_level[i]*mem_size/(perc_size_post_comp*unit_size))){
 
 	    //printf("6, ");
 
             total_times[i] += current_page.decomp_time;
 	    ssd_total_times[i] += current_page.decomp_time;
+	    if (timed){
+	      addStall(current_page.timestamp, current_page.decomp_time, current_page.comp_time, &busy_until[i], &stall_times[i]);
+	      addStall(current_page.timestamp, current_page.decomp_time, current_page.comp_time, &ssd_busy_until[i], &ssd_stall_times[i]);
+	    }
             comp_times[i] += current_page.comp_time;
             comp_decomp += current_page.comp_time+current_page.decomp_time;
             comp_count++;
 	    preFetch(index, i);
-	    //int offset = (int)((mem_size/4096)*(1-comp_perc_level[i]))+(comp_perc_level[i]*mem_size/(perc_size_post_comp*4096));
+	    //int offset = (int)((mem_size/unit_size)*(1-comp_perc_level[i]))+(comp_perc_level[i]*mem_size/(perc_size_post_comp*unit_size));
 	    //spatialPreFetch(index, i, offset);
 
 	    //printf("7, ");
@@ -363,6 +601,10 @@ int main(int argc, char *argv[]){
 	    //printf("8, ");
             total_times[i] += disk_time;
 	    ssd_total_times[i] += ssd_time;
+	    if (timed){
+	      addStall(current_page.timestamp, disk_time, 0, &busy_until[i], &stall_times[i]);
+	      addStall(current_page.timestamp, ssd_time, 0, &ssd_busy_until[i], &ssd_stall_times[i]);
+	    }
             //fragmentation[i].add(current_page.comp_size);
           }
           
@@ -373,13 +615,18 @@ int main(int argc, char *argv[]){
       }
     }
     if (index == -1){
-      mem_used += 4096;
+      mem_used += unit_size;
     }
 
     //printf("10\n");
+    if (checkpoint && ckpt.next_record % TRACE_INDEX_CHUNK == 0 && saveCheckpoint(checkpoint_path.c_str(), &ckpt) != 0)
+      printf("Unable to save a checkpoint to %s\n", checkpoint_path.c_str());
   }
   
   printf("MADE IT THROUGH THE MAIN LOOP OF ALL PAGES! *******************************************************\n");
+  if (ckpt.first_record > 0)
+    printf("Simulated records %llu to %llu, in which %lld pages came back that left before\n",
+           (unsigned long long)ckpt.first_record, (unsigned long long)ckpt.next_record, unseen);
   int i;
   int index = 0;
   double min_percent = 1.0;
@@ -393,6 +640,8 @@ int main(int argc, char *argv[]){
   double ssd_time_spent = 0.0;
   for (i=0; i<num_cache; i++){
     printf("Total time: %f, Comp time saved: %f\n", (double)total_times[i]/1000000000, (double)comp_times[i]/1000000000);
+    if (timed)
+      printf("Stall time: %f, SSD stall time: %f\n", (double)stall_times[i]/1000000000, (double)ssd_stall_times[i]/1000000000);
     //printf("Frag average: %f,  %d\n", fragmentation[i].getAverage(), fragmentation[i].getInsert());
 
     fetch_hit_rate = (double)num_fetch_hits[i]/(double)num_fetch_possible[i];
@@ -0,0 +1,140 @@
+#include <iostream>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+#include "trace_map.h"
+
+using namespace std;
+
+/*
+ * Measures how fast a trace can be read, once through stdio the way Framework
+ * used to read it and once through trace_map, so the input side of Framework
+ * can be compared against the device. Every word of every page is summed so
+ * that both readers actually touch the data.
+ *
+ * Each pass first evicts the trace from the page cache, so that it reads from
+ * the device rather than memory. Eviction cannot drop pages that another
+ * process maps or has dirtied; echo 1 > /proc/sys/vm/drop_caches does.
+ *
+ * Compile instructions:
+ * g++ -O2 TraceBench.cpp -o TraceBench
+ *
+ * Usage:
+ * ./TraceBench trace [stdio|map]
+ */
+
+long long now_ns(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec*1000000000 + now.tv_nsec;
+}
+
+void report(const char *method, long long records, long long bytes, long long elapsed, uint64_t sum){
+  printf("%-6s %lld records, %lld bytes in %f s: %f MB/s (checksum %llx)\n", method, records, bytes,
+         (double)elapsed/1000000000, (double)bytes/1048576/((double)elapsed/1000000000), (unsigned long long)sum);
+}
+
+/*
+ * Drops the whole file from the page cache.
+ */
+void evict(const char *name){
+  int fd = open(name, O_RDONLY);
+  if (fd >= 0){
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+int benchStdio(const char *name){
+  evict(name);
+  FILE *file = fopen(name, "r");
+  trace_header header;
+  if (file == NULL || trace_read_header(file, TRACE_MAGIC, &header) != 0){
+    printf("Unable to read %s.\n", name);
+    return -2;
+  }
+  uint64_t *page = (uint64_t *)malloc(header.granularity);
+  trace_clock clock;
+  trace_clock_init(&clock, &header);
+  uint64_t number, time_ns, sum = 0;
+  uint32_t tid;
+  long long records = 0;
+
+  long long start = now_ns();
+  while (trace_read_record_head(file, &header, &clock, &number, &time_ns, &tid) == 0 &&
+         fread(page, header.granularity, 1, file) == 1){
+    for (uint64_t i = 0; i < header.granularity/sizeof(uint64_t); i++)
+      sum += page[i];
+    records++;
+  }
+  report("stdio", records, ftell(file), now_ns() - start, sum);
+
+  free(page);
+  fclose(file);
+  return 0;
+}
+
+int benchMap(const char *name){
+  evict(name);
+  FILE *file = fopen(name, "r");
+  trace_header header;
+  if (file == NULL || trace_read_header(file, TRACE_MAGIC, &header) != 0){
+    printf("Unable to read %s.\n", name);
+    return -2;
+  }
+  trace_map map;
+  if (trace_map_open(&map, name, ftell(file), TRACE_MAP_DEFAULT_WINDOW) != 0){
+    printf("Unable to map %s.\n", name);
+    return -2;
+  }
+  fclose(file);
+  trace_clock clock;
+  trace_clock_init(&clock, &header);
+  uint64_t number, time_ns, sum = 0;
+  uint32_t tid;
+  long long records = 0;
+  const uint8_t *page;
+
+  long long start = now_ns();
+  trace_map_prefetch(&map, map.pos);
+  while (trace_map_record_head(&map, &header, &clock, &number, &time_ns, &tid) == 0 &&
+         (page = (const uint8_t *)trace_map_get(&map, header.granularity)) != NULL){
+    // pages of timestamped traces may be unaligned
+    for (uint64_t i = 0; i < header.granularity; i += sizeof(uint64_t)){
+      uint64_t word;
+      memcpy(&word, page + i, sizeof(word));
+      sum += word;
+    }
+    records++;
+    trace_map_release(&map, map.pos);
+  }
+  report("map", records, map.pos, now_ns() - start, sum);
+
+  trace_map_close(&map);
+  return 0;
+}
+
+int main(int argc, char *argv[]){
+
+  if (argc != 2 && argc != 3){
+    printf("Invalid use of command. Include one trace, optionally followed by stdio or map.\n");
+    return -1;
+  }
+
+  bool stdio = argc == 2 || string(argv[2]) == "stdio";
+  bool mapped = argc == 2 || string(argv[2]) == "map";
+  if (!stdio && !mapped){
+    printf("Unknown reader: %s\n", argv[2]);
+    return -1;
+  }
+
+  if (stdio && benchStdio(argv[1]) != 0)
+    return -2;
+  if (mapped && benchMap(argv[1]) != 0)
+    return -2;
+  return 0;
+}
@@ -0,0 +1,159 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <queue>
+#include <vector>
+#include "trace.h"
+
+using namespace std;
+
+/*
+ * Combines the per-process shards written by the interposer (one per pid, see
+ * openShard() in memoryFunctions.c) into a single trace that Framework can read.
+ *
+ * Shards are ordered by the time their process started tracing, and when all of
+ * them carry record timestamps the records are interleaved by time. Otherwise
+ * shards are concatenated. Every page number is tagged with the index of its
+ * shard (TRACE_SHARD_SHIFT) so that equal virtual addresses in different
+ * processes remain different pages.
+ *
+ * Compile instructions:
+ * g++ -O2 TraceMerge.cpp -o TraceMerge
+ *
+ * Usage:
+ * ./TraceMerge merged_output SPEC_Dump.txtbench.1234 SPEC_Dump.txtbench.1235 ...
+ */
+
+typedef struct {
+  const char   *name;
+  FILE         *file;
+  trace_header header;
+  trace_clock  clock;
+  // head of the next record, already read
+  uint64_t     pageNumber;
+  uint64_t     time_ns;
+  uint32_t     tid;
+  long long    count;
+} shard;
+
+// min-heap order on the time of each shard's next record
+struct laterRecord {
+  vector<shard> *shards;
+  bool operator()(int a, int b) const {
+    if ((*shards)[a].time_ns != (*shards)[b].time_ns)
+      return (*shards)[a].time_ns > (*shards)[b].time_ns;
+    return a > b;
+  }
+};
+
+bool startedEarlier(const shard &a, const shard &b){
+  if (a.header.start_ns != b.header.start_ns)
+    return a.header.start_ns < b.header.start_ns;
+  return a.header.pid < b.header.pid;
+}
+
+int main(int argc, char *argv[]){
+
+  if (argc < 3){
+    printf("Invalid use of command. Include one output file followed by the shards to merge.\n");
+    return -1;
+  }
+  if (argc - 2 > (int)TRACE_MAX_SHARDS){
+    printf("Too many shards, at most %llu can be merged.\n", (unsigned long long)TRACE_MAX_SHARDS);
+    return -1;
+  }
+
+  vector<shard> shards;
+  for (int i = 2; i < argc; i++){
+    shard current;
+    current.name = argv[i];
+    current.file = fopen(argv[i], "r");
+    if (current.file == NULL){
+      printf("Invalid file name: %s\n", argv[i]);
+      return -2;
+    }
+    if (trace_read_header(current.file, TRACE_MAGIC, &current.header) != 0){
+      printf("Unsupported trace header in %s\n", argv[i]);
+      return -3;
+    }
+    if (!shards.empty() && current.header.granularity != shards[0].header.granularity){
+      printf("%s was traced at %llu bytes per page but %s at %llu\n", argv[i], (unsigned long long)current.header.granularity,
+             shards[0].name, (unsigned long long)shards[0].header.granularity);
+      return -3;
+    }
+    shards.push_back(current);
+  }
+  stable_sort(shards.begin(), shards.end(), startedEarlier);
+
+  FILE *outfile = fopen(argv[1], "w+");
+  if (outfile == NULL){
+    printf("Invalid output file name.\n");
+    return -2;
+  }
+
+  uint64_t granularity = shards[0].header.granularity;
+  bool timed = true;
+  for (size_t i = 0; i < shards.size(); i++)
+    timed = timed && (shards[i].header.flags & TRACE_FLAG_TIMESTAMPS);
+
+  trace_header merged;
+  trace_init_header(&merged, TRACE_MAGIC, granularity);
+  merged.flags = timed ? TRACE_FLAG_TIMESTAMPS : 0;
+  merged.start_ns = shards[0].header.start_ns;
+  fwrite(&merged, sizeof(trace_header), 1, outfile);
+
+  trace_clock outClock;
+  trace_clock_init(&outClock, &merged);
+  uint8_t stamp[2*TRACE_MAX_VARINT];
+  char *page = (char *)malloc(granularity);
+  long long total = 0;
+
+  // shards still holding records, earliest next record first
+  laterRecord order = { &shards };
+  priority_queue<int, vector<int>, laterRecord> pending(order);
+  for (size_t i = 0; i < shards.size(); i++){
+    shards[i].count = 0;
+    trace_clock_init(&shards[i].clock, &shards[i].header);
+    if (trace_read_record_head(shards[i].file, &shards[i].header, &shards[i].clock,
+                               &shards[i].pageNumber, &shards[i].time_ns, &shards[i].tid) == 0){
+      // without timestamps, order shards by their start instead
+      if (!timed) shards[i].time_ns = i;
+      pending.push(i);
+    }
+  }
+
+  while (!pending.empty()){
+    int i = pending.top();
+    pending.pop();
+    if (fread(page, granularity, 1, shards[i].file) != 1)
+      continue;
+
+    uint64_t pageNumber = shards[i].pageNumber | ((uint64_t)i << TRACE_SHARD_SHIFT);
+    fwrite(&pageNumber, sizeof(pageNumber), 1, outfile);
+    if (timed)
+      fwrite(stamp, trace_encode_stamp(&outClock, shards[i].time_ns, shards[i].tid, stamp), 1, outfile);
+    fwrite(page, granularity, 1, outfile);
+    shards[i].count++;
+    total++;
+
+    uint64_t time_ns = shards[i].time_ns;
+    if (trace_read_record_head(shards[i].file, &shards[i].header, &shards[i].clock,
+                               &shards[i].pageNumber, &shards[i].time_ns, &shards[i].tid) == 0){
+      if (!timed) shards[i].time_ns = time_ns;
+      pending.push(i);
+    }
+  }
+
+  for (size_t i = 0; i < shards.size(); i++){
+    printf("shard %zu: pid %u (parent %u) %lld pages from %s\n", i, shards[i].header.pid, shards[i].header.ppid,
+           shards[i].count, shards[i].name);
+    fclose(shards[i].file);
+  }
+
+  fclose(outfile);
+  free(page);
+  printf("Merged %lld pages from %zu shards\n", total, shards.size());
+  return 0;
+}
@@ -46,6 +46,33 @@
 #if DICTIONARY_ORG == FULLY_ASSOCIATIVE_CONST_LOOKUP_ORG
 #include "WK_hashmap.h"
 #endif
+/* A variant's generic packers are its own, too (see WK.h). */
+#if defined WK_VARIANT
+#define WK_pack_bits   WK_VARIANT_SYMBOL(WK_pack_bits, WK_VARIANT)
+#define WK_unpack_bits WK_VARIANT_SYMBOL(WK_unpack_bits, WK_VARIANT)
+#endif
+/**
+ * Modeling classifies blocks of words before it consults the dictionary, and encodes the zeros and the words that match the last
+ * nonzero word without a lookup (see WK_classify_block(), below).  This relies on words being modeled in order, and on the lookup
+ * finding the entry at the front of a set first, which the constant-time map also does (see WK_hashmap.h).
+ **/
+#if WK_STRIDE == 1
+#define WK_MODEL_RUNS 1
+#endif
+/**
+ * WK_FUSED selects fused coding: the compressor packs tags, dictionary indices and low bits into words as it models, and the
+ * decompressor unpacks them as it goes, instead of both passing every value through page-sized arrays of unpacked entries.  The
+ * packed format is the same.  It is not the default because, where the packers below have AVX2 versions, packing the arrays in
+ * bulk costs less than packing one value at a time.
+ **/
+/**
+ * Classification and the packers have AVX2 versions, used when the CPU has it.  WK_NO_AVX2 leaves them out.
+ **/
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(WK_32_BIT_WORD) && !defined(WK_NO_AVX2)
+#include <immintrin.h> // AVX2 intrinsics
+#define WK_HAVE_AVX2 1
+#define WK_CPU_HAS_AVX2() __builtin_cpu_supports("avx2")
+#endif
 /* =============================================================================================================================== */
 /* =============================================================================================================================== */
 /* MACROS */
@@ -483,6 +510,7 @@ typedef uint16_t WK_unpacked_16_to_64_t;
  * script 'hash_lookup_gen.py'.
  **/
 #include "hash-lookup-table.h"
+static const unsigned int hash_lookup_table [] = HASH_LOOKUP_TABLE_CONTENTS;
 /* Assume that the low byte of the high bits are used to hash into the lookup table. */
 #define HASH_TO_SET(pattern)		\
   (hash_lookup_table[HIGH_BITS(pattern) & 0xFF])
@@ -493,24 +521,157 @@ typedef uint16_t WK_unpacked_16_to_64_t;
 #define EMIT_BYTE(fill_ptr,byte_value) {*fill_ptr++ = byte_value;}
 #define EMIT_WORD(fill_ptr,word_value) {*fill_ptr++ = word_value;}
 /**
- * RECORD... record the results of modeling in the intermediate arrays
+ * RECORD... record the results of modeling, packed as they come (see PACK_FIELD, below) or in the intermediate arrays.  The _IF forms
+ * record a value only if the condition is 1, without branching, and the _REPEAT form records count copies of one value.
  */
+#if defined WK_FUSED
+#define RECORD_TAG(tag) \
+  PACK_FIELD(tags, WK_unpacked_tags_t, NUM_TAG_BITS, (tag), 1)
+#define RECORD_DICT_INDEX_IF(dict_index,condition) \
+  PACK_FIELD(dict_indices, WK_unpacked_dict_index_t, NUM_DICT_INDEX_BITS, (dict_index), (condition))
+#define RECORD_LOW_BITS_IF(low_bits_pattern,condition) \
+  PACK_FIELD(low_bits, WK_unpacked_low_bits_t, NUM_LOW_BITS, (low_bits_pattern), (condition))
+#define RECORD_DICT_INDEX_REPEAT(dict_index,count) \
+  PACK_FIELD_REPEAT(dict_indices, WK_unpacked_dict_index_t, NUM_DICT_INDEX_BITS, DICT_INDEX_PACKING_MASK, (dict_index), (count))
+#define RECORD_ZEROS(count) \
+  PACK_FIELD_ZEROS(tags, WK_unpacked_tags_t, NUM_TAG_BITS, (count))
+#else
+#define RECORD_TAG(tag) EMIT_BYTE(next_tag,(tag))
+#define RECORD_DICT_INDEX_IF(dict_index,condition) { \
+    *next_dict_index = (dict_index);		     \
+    next_dict_index += (condition);		     \
+  }
+#define RECORD_LOW_BITS_IF(low_bits_pattern,condition) { \
+    *next_low_bits = (low_bits_pattern);		 \
+    next_low_bits += (condition);			 \
+  }
+#define RECORD_DICT_INDEX_REPEAT(dict_index,count) {	 \
+    for (unsigned int repeat = 0; repeat < (count); ++repeat) { \
+      *next_dict_index++ = (dict_index);			 \
+    }								 \
+  }
+#define RECORD_ZEROS(count) {				 \
+    memset(next_tag, ZERO_TAG, (count) * sizeof(WK_unpacked_tags_t)); \
+    next_tag += (count);					 \
+  }
+#endif /* WK_FUSED */
 #define RECORD_ZERO {             \
-    EMIT_BYTE(next_tag,ZERO_TAG); \
+    RECORD_TAG(ZERO_TAG);	  \
   }
 #define RECORD_EXACT(dict_index) {          \
-    EMIT_BYTE(next_tag,EXACT_TAG);	    \
-    EMIT_BYTE(next_dict_index,(dict_index));	\
+    RECORD_TAG(EXACT_TAG);		    \
+    RECORD_DICT_INDEX_IF((dict_index), 1);  \
   }
 #define RECORD_PARTIAL(dict_index,low_bits_pattern) { \
-    EMIT_BYTE(next_tag,PARTIAL_TAG);		      \
-    EMIT_BYTE(next_dict_index,(dict_index));	      \
-    EMIT_WORD(next_low_bits,(low_bits_pattern));      \
+    RECORD_TAG(PARTIAL_TAG);			      \
+    RECORD_DICT_INDEX_IF((dict_index), 1);	      \
+    RECORD_LOW_BITS_IF((low_bits_pattern), 1);	      \
   }
 #define RECORD_MISS(word_pattern) {           \
-    EMIT_BYTE(next_tag,MISS_TAG);             \
+    RECORD_TAG(MISS_TAG);		      \
     EMIT_WORD(next_full_patt,(word_pattern)); \
   }
+/**
+ * RECORDED_WORDS... the size of the compressed page so far, in words: the header, tags and full words up to the last full word
+ * recorded, and the dictionary indices and low bits recorded, once packed.  None of these shrink as modeling goes on, so a page
+ * is over its budget as soon as this is, and when modeling is done this is the size of the page.
+ **/
+#if defined WK_FUSED
+#define RECORDED_DICT_INDICES dict_indices_count
+#define RECORDED_LOW_BITS     low_bits_count
+#else
+#define RECORDED_DICT_INDICES ((unsigned int)(next_dict_index - temp_dict_indices))
+#define RECORDED_LOW_BITS     ((unsigned int)(next_low_bits - temp_low_bits))
+#endif /* WK_FUSED */
+#define PACKED_WORDS(count,entry_type,bits_per_value) \
+  (((count) + PACKING_GROUP(entry_type, bits_per_value) - 1) / PACKING_GROUP(entry_type, bits_per_value))
+#define RECORDED_WORDS							\
+  ((unsigned int)(next_full_patt - dest_buf) +				\
+   PACKED_WORDS(RECORDED_DICT_INDICES, WK_unpacked_dict_index_t, NUM_DICT_INDEX_BITS) + \
+   PACKED_WORDS(RECORDED_LOW_BITS, WK_unpacked_low_bits_t, NUM_LOW_BITS))
+/* Words modeled between checks of the budget, and the check, which gives up on a page over max_words. */
+#define BUDGET_CHECK_WORDS 64
+#define CHECK_BUDGET {				\
+    if (RECORDED_WORDS > max_words) {		\
+      return NULL;				\
+    }						\
+  }
+/**
+ * READ... read back, in the decompressor, what was recorded.
+ **/
+#if defined WK_FUSED
+#define READ_TAG(tag) \
+  UNPACK_FIELD(tags, WK_unpacked_tags_t, NUM_TAG_BITS, tag)
+#define READ_DICT_INDEX(dict_index) \
+  UNPACK_FIELD(dict_indices, WK_unpacked_dict_index_t, NUM_DICT_INDEX_BITS, dict_index)
+#define READ_LOW_BITS(low_bits_pattern) \
+  UNPACK_FIELD(low_bits, WK_unpacked_low_bits_t, NUM_LOW_BITS, low_bits_pattern)
+#else
+#define READ_TAG(tag)                   {tag = *next_tag++;}
+#define READ_DICT_INDEX(dict_index)     {dict_index = *next_dict_index++;}
+#define READ_LOW_BITS(low_bits_pattern) {low_bits_pattern = *next_low_bits++;}
+#endif /* WK_FUSED */
+#if !defined WK_FUSED
+/**
+ * TAG RUNS and GROUPS... let the decompressor take its unpacked tags several at a time.  A run of eight tags of one kind, read as
+ * a single word, is unmodeled by a loop for that kind.  Otherwise the next four tags, two bits each, index a table that says
+ * whether any is a miss, how far the group advances the dictionary indices and low bits, and where in those each of its tags
+ * finds its own.  Groups of zeros, exact and partial matches are then unmodeled without branching on their tags, and groups
+ * with misses branch only on whether each tag is a miss.
+ **/
+#define TAG_RUN_SIZE   8
+#define TAG_RUN_BYTES  0x0101010101010101ULL
+#define TAG_GROUP_SIZE 4
+typedef struct {
+  uint8_t has_miss;
+  uint8_t dict_indices;
+  uint8_t low_bits;
+  uint8_t dict_index_offset[TAG_GROUP_SIZE];
+  uint8_t low_bits_offset[TAG_GROUP_SIZE];
+} WK_tag_group_s;
+#define TAG_GROUP_TAG(group,position) (((group) >> (NUM_TAG_BITS * (position))) & 0x3)
+#define TAG_IS_ZERO(tag)           ((tag) == ZERO_TAG)
+#define TAG_IS_MISS(tag)           ((tag) == MISS_TAG)
+#define TAG_HAS_DICT_INDEX(tag)    ((tag) == PARTIAL_TAG || (tag) == EXACT_TAG)
+#define TAG_HAS_LOW_BITS(tag)      ((tag) == PARTIAL_TAG)
+/* The number of the group's first tags that pass the test. */
+#define TAG_GROUP_COUNT(group,tags,test)				\
+  (((tags) > 0 && test(TAG_GROUP_TAG(group, 0))) + ((tags) > 1 && test(TAG_GROUP_TAG(group, 1))) + \
+   ((tags) > 2 && test(TAG_GROUP_TAG(group, 2))) + ((tags) > 3 && test(TAG_GROUP_TAG(group, 3))))
+#define TAG_GROUP(group) {						\
+    TAG_GROUP_COUNT(group, 4, TAG_IS_MISS) != 0,			\
+    TAG_GROUP_COUNT(group, 4, TAG_HAS_DICT_INDEX),			\
+    TAG_GROUP_COUNT(group, 4, TAG_HAS_LOW_BITS),			\
+    {TAG_GROUP_COUNT(group, 0, TAG_HAS_DICT_INDEX), TAG_GROUP_COUNT(group, 1, TAG_HAS_DICT_INDEX), \
+     TAG_GROUP_COUNT(group, 2, TAG_HAS_DICT_INDEX), TAG_GROUP_COUNT(group, 3, TAG_HAS_DICT_INDEX)}, \
+    {TAG_GROUP_COUNT(group, 0, TAG_HAS_LOW_BITS), TAG_GROUP_COUNT(group, 1, TAG_HAS_LOW_BITS), \
+     TAG_GROUP_COUNT(group, 2, TAG_HAS_LOW_BITS), TAG_GROUP_COUNT(group, 3, TAG_HAS_LOW_BITS)}},
+#define TAG_GROUPS_16(high)						\
+  TAG_GROUP((high) * 16 +  0) TAG_GROUP((high) * 16 +  1) TAG_GROUP((high) * 16 +  2) TAG_GROUP((high) * 16 +  3) \
+  TAG_GROUP((high) * 16 +  4) TAG_GROUP((high) * 16 +  5) TAG_GROUP((high) * 16 +  6) TAG_GROUP((high) * 16 +  7) \
+  TAG_GROUP((high) * 16 +  8) TAG_GROUP((high) * 16 +  9) TAG_GROUP((high) * 16 + 10) TAG_GROUP((high) * 16 + 11) \
+  TAG_GROUP((high) * 16 + 12) TAG_GROUP((high) * 16 + 13) TAG_GROUP((high) * 16 + 14) TAG_GROUP((high) * 16 + 15)
+static const WK_tag_group_s WK_tag_groups[1 << (NUM_TAG_BITS * TAG_GROUP_SIZE)] = {
+  TAG_GROUPS_16( 0) TAG_GROUPS_16( 1) TAG_GROUPS_16( 2) TAG_GROUPS_16( 3)
+  TAG_GROUPS_16( 4) TAG_GROUPS_16( 5) TAG_GROUPS_16( 6) TAG_GROUPS_16( 7)
+  TAG_GROUPS_16( 8) TAG_GROUPS_16( 9) TAG_GROUPS_16(10) TAG_GROUPS_16(11)
+  TAG_GROUPS_16(12) TAG_GROUPS_16(13) TAG_GROUPS_16(14) TAG_GROUPS_16(15)
+};
+/**
+ * The group of the next four unpacked tags, the first in the lowest bits.  Read as a little-endian word, the tags' bytes are
+ * gathered by a multiply that shifts each of them to its place, all sums being free of carries.
+ **/
+#if defined __BYTE_ORDER__ && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define READ_TAG_GROUP(group) {						\
+    uint32_t tag_bytes;							\
+    memcpy(&tag_bytes, next_tag, sizeof(tag_bytes));			\
+    group = (tag_bytes * 0x41041) >> 18 & 0xff;				\
+  }
+#else
+#define READ_TAG_GROUP(group)						\
+  group = next_tag[0] | next_tag[1] << NUM_TAG_BITS | next_tag[2] << (2 * NUM_TAG_BITS) | next_tag[3] << (3 * NUM_TAG_BITS);
+#endif
+#endif /* !WK_FUSED */
 /* ============================================================================================================================== */
 /* ============================================================================================================================== */
 /* DICTIONARY MACROS */
@@ -521,9 +682,9 @@ typedef uint16_t WK_unpacked_16_to_64_t;
   *entry_ptr = new_word;
 #define DICT_GET_VALUE(entry_ptr) (*entry_ptr)
 #define DICT_MOVE_TO_FRONT(entry_ptr)
+#define DICT_MOVE_TO_FRONT_IF(entry_ptr,condition)
 #define DICT_CREATE()     					    \
-    dictionary_element_s dictionary[DICTIONARY_SIZE];		    \
-    unsigned int hash_lookup_table [] = HASH_LOOKUP_TABLE_CONTENTS;
+    dictionary_element_s dictionary[DICTIONARY_SIZE];
 #define DICT_INITIALIZE() {	                \
     for (int i = 0; i < DICTIONARY_SIZE; ++i) { \
       dictionary[i] = 1;	                \
@@ -578,6 +739,12 @@ typedef uint16_t WK_unpacked_16_to_64_t;
       dict_lru_head = dict_ptr;			\
     }						\
   }
+/* Move an entry to the front only if condition is 1. */
+#define DICT_MOVE_TO_FRONT_IF(dict_ptr,condition) {	\
+    if (condition) {					\
+      DICT_MOVE_TO_FRONT(dict_ptr);			\
+    }							\
+  }
 /* Try to find an entry based on the upper bits.  Move that entry to the front of the LRU queue. */
 #define DICT_LOOKUP(original_word)					\
   WK_word original_upper = HIGH_BITS(original_word);			\
@@ -619,6 +786,8 @@ typedef uint16_t WK_unpacked_16_to_64_t;
 #define DICT_SET_VALUE(entry_ptr,new_word) \
   entry_ptr->value = new_word;
 #define DICT_GET_VALUE(entry_ptr) (entry_ptr->value)
+/* The map names entries by index, and finds their keys in the dictionary. */
+#define HASHMAP_KEY(index) HIGH_BITS(DICT_GET_VALUE((dictionary + (index))))
 #define DICT_CREATE()                               \
   dictionary_element_s dictionary[DICTIONARY_SIZE]; \
   dictionary_element_s* dict_lru_head = NULL;	    \
@@ -636,6 +805,7 @@ typedef uint16_t WK_unpacked_16_to_64_t;
     dict_lru_head = dictionary;				     \
     dict_lru_tail = dictionary + (DICTIONARY_SIZE - 1);	     \
     HASHMAP_INIT(dict_map);					     \
+    HASHMAP_INSERT(dict_map, HIGH_BITS(1), 0);		     \
   }
 #define DICT_MOVE_TO_FRONT(dict_ptr) {		\
     if (dict_ptr != dict_lru_head) {		\
@@ -651,125 +821,346 @@ typedef uint16_t WK_unpacked_16_to_64_t;
       dict_lru_head = dict_ptr;			\
     }						\
   }
-/* Try to find an entry based on the upper bits.  Move that entry to the front of the LRU queue.  Use the hashmap for constant time
-   lookup; if the item isn't found, remove the hashmap entry to the LRU tail (being replaced) and add the entry to the new head. */
+/* Move an entry to the front only if condition is 1. */
+#define DICT_MOVE_TO_FRONT_IF(dict_ptr,condition) {	\
+    if (condition) {					\
+      DICT_MOVE_TO_FRONT(dict_ptr);			\
+    }							\
+  }
+/**
+ * Try to find an entry based on the upper bits, through the map.  Move that entry to the front of the LRU queue.  If there is none,
+ * the LRU tail is to be replaced: its key is unmapped, and the new key mapped to it.
+ *
+ * Every entry starts out holding 1, so the keys of entries are only ever shared by entries not yet replaced, and the map finds
+ * the most recently used of those, as the linear search does.  The map is initialized with that key mapped to the head, and
+ * whichever of them is used moves to the head; it is replaced last of them, so unmapping its key does not lose another entry.
+ * Compressor and decompressor change the map in the same way, and their dictionaries stay the same as the linear ones would.
+ **/
+#define DICT_FIND_OR_REPLACE(new_upper)					\
+  dictionary_element_s* dict_ptr;					\
+  {									\
+    int dict_found;							\
+    HASHMAP_LOOKUP(dict_found, dict_map, new_upper);			\
+    if (dict_found != HASHMAP_NONE) {					\
+      dict_ptr = dictionary + dict_found;				\
+    } else {								\
+      dict_ptr = dict_lru_tail;						\
+      HASHMAP_DELETE(dict_map, HIGH_BITS(DICT_GET_VALUE(dict_ptr)), dict_ptr - dictionary); \
+      HASHMAP_INSERT(dict_map, new_upper, dict_ptr - dictionary);	\
+    }									\
+  }
 #define DICT_LOOKUP(original_word)					\
   WK_word original_upper = HIGH_BITS(original_word);			\
-  dictionary_element_s* dict_ptr = NULL;				\
-  WK_word dict_word;							\
-  HASHMAP_LOOKUP(dict_ptr, dict_map, original_upper);			\
-  if (dict_ptr == NULL) {						\
-    dict_ptr = dict_lru_tail;						\
-    HASHMAP_DELETE(dict_map, DICT_GET_VALUE(dict_ptr));			\
-    HASHMAP_INSERT(dict_map, original_upper, dict_ptr);			\
-  }									\
+  DICT_FIND_OR_REPLACE(original_upper);					\
+  WK_word dict_word = DICT_GET_VALUE(dict_ptr);				\
   WK_unpacked_dict_index_t dict_index = dict_ptr - dictionary;		\
   DICT_MOVE_TO_FRONT(dict_ptr);
-/* SFHK: This macro is used only in decompression, where the hashmap has no role. */
 #define DICT_UPDATE(new_word) {						\
     WK_word new_upper = HIGH_BITS(new_word);				\
-    dictionary_element_s* dict_ptr = NULL;				\
-    WK_word dict_word;							\
-    for (dictionary_element_s* entry_ptr = dict_lru_head; entry_ptr != NULL; entry_ptr = entry_ptr->next) { \
-      dict_word = DICT_GET_VALUE(entry_ptr);				\
-      WK_word dict_upper = HIGH_BITS(dict_word);			\
-      if (new_upper == dict_upper) {					\
-	dict_ptr = entry_ptr;						\
-	break;								\
-      }									\
-    }									\
-    if (dict_ptr == NULL) {						\
-      dict_ptr = dict_lru_tail;						\
-    }									\
+    DICT_FIND_OR_REPLACE(new_upper);					\
     DICT_MOVE_TO_FRONT(dict_ptr);					\
     DICT_SET_VALUE(dict_ptr, new_word);					\
   }
 /* ===== SET ASSOCIATIVE DICTIONARY  ===== */
 #elif DICTIONARY_ORG == SET_ASSOCIATIVE_ORG
+/**
+ * The entries of a set are contiguous, and the set's LRU order is kept apart from them, as the entries' indices within the set,
+ * most recently used first.  A set of up to 16 entries packs its order into a word, four bits per entry, so that moving an entry
+ * to the front splices its index out of the word and into the bottom without a loop.  A larger set keeps its order in an array
+ * and moves the indices before the entry's down by one.  Either way, a lookup walks the set in order, as the linked lists once
+ * did, but the next entry's address comes from the order rather than from the entry before it.
+ **/
+#if DICTIONARY_SET_SIZE <= 16
+typedef uint64_t dict_order_t;
+#define SET_ORDER_INITIAL 0xfedcba9876543210ULL
+#define SET_ORDER_ENTRY(set_order,position) ((unsigned int)(*(set_order) >> (4 * (position))) & 0xf)
+#else
+typedef struct {
+#if DICTIONARY_SET_SIZE <= 256
+  uint8_t  entries[DICTIONARY_SET_SIZE];
+#else
+  uint16_t entries[DICTIONARY_SET_SIZE];
+#endif
+} dict_order_t;
+#define SET_ORDER_ENTRY(set_order,position) ((unsigned int)(set_order)->entries[position])
+#endif
+/**
+ * Find the entry of a set to use for a word: the most recently used of those whose high bits are the word's, or else the least
+ * recently used.
+ *
+ * \return The entry's position in the set's LRU order.
+ **/
+static inline unsigned int
+WK_set_find (const dictionary_element_s* set_values,
+	     const dict_order_t* set_order,
+	     WK_word upper) {
+#if DICTIONARY_SET_SIZE <= 16
+  dict_order_t order    = *set_order;
+  unsigned int position = 0;
+  while (position < DICTIONARY_SET_SIZE - 1 && HIGH_BITS(set_values[order & 0xf]) != upper) {
+    order >>= 4;
+    ++position;
+  }
+  return position;
+#else
+  unsigned int position = 0;
+  while (position < DICTIONARY_SET_SIZE - 1 && HIGH_BITS(set_values[SET_ORDER_ENTRY(set_order, position)]) != upper) {
+    ++position;
+  }
+  return position;
+#endif
+}
+/* \return The position of an entry in the set's LRU order. */
+static inline unsigned int
+WK_set_position (const dict_order_t* set_order,
+		 unsigned int entry) {
+#if DICTIONARY_SET_SIZE <= 16
+  /* Find the lowest four bits that are the entry's index, by the lowest that are zero once the index is cancelled out. */
+  uint64_t differ = *set_order ^ (entry * 0x1111111111111111ULL);
+  uint64_t zero   = (differ - 0x1111111111111111ULL) & ~differ & 0x8888888888888888ULL;
+  return __builtin_ctzll(zero) / 4;
+#else
+  unsigned int position = 0;
+  while (SET_ORDER_ENTRY(set_order, position) != entry) {
+    ++position;
+  }
+  return position;
+#endif
+}
+/* Make the entry at a position of the set's LRU order its most recently used. */
+static inline void
+WK_set_move_to_front (dict_order_t* set_order,
+		      unsigned int position) {
+  if (position != 0) {
+#if DICTIONARY_SET_SIZE <= 16
+    uint64_t before = ((uint64_t)1 << (4 * position)) - 1;
+    *set_order = (*set_order & ~((before << 4) | 0xf)) | ((*set_order & before) << 4) | SET_ORDER_ENTRY(set_order, position);
+#else
+    unsigned int entry = SET_ORDER_ENTRY(set_order, position);
+    memmove(set_order->entries + 1, set_order->entries, position * sizeof(set_order->entries[0]));
+    set_order->entries[0] = entry;
+#endif
+  }
+}
 #define DICT_SET_VALUE(entry_ptr,new_word) \
-  entry_ptr->value = new_word;
-#define DICT_GET_VALUE(entry_ptr) (entry_ptr->value)
-#define DICT_CREATE()							\
-  dictionary_element_s dictionary[DICTIONARY_SIZE];			\
-  dictionary_element_s* set_lru_head[DICTIONARY_NUM_SETS];		\
-  dictionary_element_s* set_lru_tail[DICTIONARY_NUM_SETS];		\
-  unsigned int hash_lookup_table [] = HASH_LOOKUP_TABLE_CONTENTS;
-#define DICT_INITIALIZE() {						\
-    for (int i = 0; i < DICTIONARY_NUM_SETS; ++i) {			\
-      dictionary_element_s* set_base  = dictionary + (i * DICTIONARY_SET_SIZE); \
-      dictionary_element_s* set_limit = set_base + DICTIONARY_SET_SIZE; \
-      dictionary_element_s* set_last = set_limit - 1;			\
-      for (dictionary_element_s* init_element = set_base; init_element != set_limit; ++init_element) { \
-	DICT_SET_VALUE(init_element, 1);				\
-	init_element->next  = init_element + 1;				\
-	init_element->prev  = init_element - 1;				\
-      }									\
-      set_base->prev = NULL;						\
-      set_last->next = NULL;						\
-      set_lru_head[i] = set_base;					\
-      set_lru_tail[i] = set_last;					\
-    }									\
+  *entry_ptr = new_word;
+#define DICT_GET_VALUE(entry_ptr) (*entry_ptr)
+#define DICT_CREATE()					\
+  dictionary_element_s dictionary[DICTIONARY_SIZE];	\
+  dict_order_t         dict_order[DICTIONARY_NUM_SETS];
+#if DICTIONARY_SET_SIZE <= 16
+#define DICT_INITIALIZE() {				\
+    for (int i = 0; i < DICTIONARY_SIZE; ++i) {		\
+      dictionary[i] = 1;				\
+    }							\
+    for (int i = 0; i < DICTIONARY_NUM_SETS; ++i) {	\
+      dict_order[i] = SET_ORDER_INITIAL;		\
+    }							\
+  }
+#else
+#define DICT_INITIALIZE() {				\
+    for (int i = 0; i < DICTIONARY_SIZE; ++i) {		\
+      dictionary[i] = 1;				\
+      dict_order[i / DICTIONARY_SET_SIZE].entries[i % DICTIONARY_SET_SIZE] = i % DICTIONARY_SET_SIZE; \
+    }							\
   }
+#endif
 #define DICT_MOVE_TO_FRONT(dict_ptr) {					\
-    int dict_index = dict_ptr - dictionary;				\
-    int set_number = dict_index / DICTIONARY_SET_SIZE;			\
-    if (dict_ptr != set_lru_head[set_number]) {				\
-      dict_ptr->prev->next = dict_ptr->next;				\
-      if (dict_ptr != set_lru_tail[set_number]) {			\
-	dict_ptr->next->prev = dict_ptr->prev;				\
-      } else {								\
-	set_lru_tail[set_number] = dict_ptr->prev;			\
-      }									\
-      set_lru_head[set_number]->prev = dict_ptr;			\
-      dict_ptr->next                 = set_lru_head[set_number];	\
-      dict_ptr->prev                 = NULL;				\
-      set_lru_head[set_number]       = dict_ptr;			\
-    }									\
+    unsigned int  dict_moved = dict_ptr - dictionary;			\
+    dict_order_t* set_order  = dict_order + dict_moved / DICTIONARY_SET_SIZE; \
+    WK_set_move_to_front(set_order, WK_set_position(set_order, dict_moved % DICTIONARY_SET_SIZE)); \
+  }
+/* Move an entry to the front only if condition is 1, by moving the entry at the front there otherwise. */
+#define DICT_MOVE_TO_FRONT_IF(dict_ptr,condition) {			\
+    unsigned int  dict_moved = dict_ptr - dictionary;			\
+    dict_order_t* set_order  = dict_order + dict_moved / DICTIONARY_SET_SIZE; \
+    WK_set_move_to_front(set_order, WK_set_position(set_order, dict_moved % DICTIONARY_SET_SIZE) & -(unsigned int)(condition)); \
   }
-/* Try to find an entry in this set based on the upper bits.  Move that entry to the front of the set's LRU queue. */
+/* Try to find an entry in this set based on the upper bits.  Move that entry to the front of the set's LRU order. */
 #define DICT_LOOKUP(original_word)					\
-  WK_word original_upper         = HIGH_BITS(original_word);		\
-  dictionary_element_s* dict_ptr = NULL;				\
-  unsigned int set_number        = HASH_TO_SET(original_word);		\
-  WK_word dict_word;							\
-  for (dictionary_element_s* entry_ptr = set_lru_head[set_number]; entry_ptr != NULL; entry_ptr = entry_ptr->next) { \
-    dict_word = DICT_GET_VALUE(entry_ptr);				\
-    WK_word dict_upper = HIGH_BITS(dict_word);				\
-    if (original_upper == dict_upper) {					\
-      dict_ptr = entry_ptr;						\
-      break;								\
-    }									\
-  }									\
-  if (dict_ptr == NULL) {						\
-    dict_ptr = set_lru_tail[set_number];				\
-  }									\
-  DICT_MOVE_TO_FRONT(dict_ptr);						\
-  WK_unpacked_dict_index_t dict_index = dict_ptr - dictionary;
+  unsigned int          set_number    = HASH_TO_SET(original_word);	\
+  dictionary_element_s* set_values    = dictionary + set_number * DICTIONARY_SET_SIZE; \
+  unsigned int          dict_position = WK_set_find(set_values, dict_order + set_number, HIGH_BITS(original_word)); \
+  dictionary_element_s* dict_ptr      = set_values + SET_ORDER_ENTRY(dict_order + set_number, dict_position); \
+  WK_word dict_word                   = DICT_GET_VALUE(dict_ptr);	\
+  WK_unpacked_dict_index_t dict_index = dict_ptr - dictionary;		\
+  WK_set_move_to_front(dict_order + set_number, dict_position);
 #define DICT_UPDATE(new_word) {						\
-    WK_word new_upper = HIGH_BITS(new_word);				\
-    int set_number = HASH_TO_SET(new_word);				\
-    dictionary_element_s* dict_ptr = NULL;				\
-    WK_word dict_word;							\
-    for (dictionary_element_s* entry_ptr = set_lru_head[set_number]; entry_ptr != NULL; entry_ptr = entry_ptr->next) { \
-      dict_word = DICT_GET_VALUE(entry_ptr);				\
-      WK_word dict_upper = HIGH_BITS(dict_word);			\
-      if (new_upper == dict_upper) {				\
-	dict_ptr = entry_ptr;						\
-	break;								\
-      }									\
-    }									\
-    if (dict_ptr == NULL) {						\
-      dict_ptr = set_lru_tail[set_number];						\
-    }									\
-    DICT_MOVE_TO_FRONT(dict_ptr);					\
+    unsigned int          set_number    = HASH_TO_SET(new_word);	\
+    dictionary_element_s* set_values    = dictionary + set_number * DICTIONARY_SET_SIZE; \
+    unsigned int          dict_position = WK_set_find(set_values, dict_order + set_number, HIGH_BITS(new_word)); \
+    dictionary_element_s* dict_ptr      = set_values + SET_ORDER_ENTRY(dict_order + set_number, dict_position); \
+    WK_set_move_to_front(dict_order + set_number, dict_position);	\
     DICT_SET_VALUE(dict_ptr, new_word);					\
   }
 #else
 #error "Unknown dictionary organization."
 #endif /* DICTIONARY_ORG */
+/**
+ * Model a nonzero word against the dictionary, record the result, and leave the word in the dictionary entry it was matched to or
+ * replaced, which is assigned to entry_ptr.
+ **/
+#define MODEL_NONZERO_WORD(input_word,entry_ptr) {			\
+    DICT_LOOKUP(input_word);						\
+    if (input_word == dict_word) {					\
+      RECORD_EXACT(dict_index);						\
+    } else {								\
+      if (HIGH_BITS(input_word) == HIGH_BITS(dict_word)) {		\
+	RECORD_PARTIAL(dict_index, LOW_BITS(input_word));		\
+      } else {								\
+	RECORD_MISS(input_word);					\
+      }									\
+      DICT_SET_VALUE(dict_ptr, input_word);				\
+    }									\
+    DICT_MOVE_TO_FRONT(dict_ptr);					\
+    entry_ptr = dict_ptr;						\
+  }
+/**
+ * UNMODEL... restore a word, of the kind its tag gives, at output_ptr, and leave the dictionary as modeling the word did.
+ **/
+/* It was just a zero.  The dictionary is unused; just append the zero to the decompressed buffer. */
+#define UNMODEL_ZERO(output_ptr) {		\
+    *(output_ptr) = 0;				\
+  }
+/*
+ * For an exact match, just lookup the given dictionary entry and use its words.  Because the match was exact, no update to the
+ * dictionary is needed.
+ */
+#define UNMODEL_EXACT(output_ptr) {				\
+    WK_word dict_index;						\
+    READ_DICT_INDEX(dict_index);				\
+    dictionary_element_s* dict_ptr = dictionary + dict_index;	\
+    *(output_ptr) = DICT_GET_VALUE(dict_ptr);			\
+    DICT_MOVE_TO_FRONT(dict_ptr);				\
+  }
+/*
+ * The upper bits of the dictionary entry match, but the lower bits don't.  Reconstruct the correct word, but update the dictionary
+ * entry to use these new low bits.  Note that we don't perform a replacement on the dictionary entry -- we just update this entry
+ * in-place.  One could argue that something more complex should happen with this set of the dictionary, but for now we keep it
+ * simple.
+ */
+#define UNMODEL_PARTIAL(output_ptr) {					\
+    WK_word dict_index, low_bits_pattern;				\
+    READ_DICT_INDEX(dict_index);					\
+    READ_LOW_BITS(low_bits_pattern);					\
+    dictionary_element_s* dict_ptr = dictionary + dict_index;		\
+    WK_word dict_entry = DICT_GET_VALUE(dict_ptr);			\
+    /* Zero the low bits and then paste them into place from the compressed encoding's low-bits collection. */ \
+    dict_entry &= HIGH_BITS_MASK;					\
+    dict_entry |= low_bits_pattern;					\
+    /* Given this new word value, update the dictionary entry and add the word to the decompressed buffer. */ \
+    *(output_ptr) = dict_entry;						\
+    DICT_SET_VALUE(dict_ptr, dict_entry);				\
+    DICT_MOVE_TO_FRONT(dict_ptr);					\
+  }
+/*
+ * For an outright miss, the full value must be taken from the compressed pool of full word patterns.  Here, the dictionary must be
+ * updated by replacing some word in the set (if it is full) with this new, wholly unmatching word.
+ */
+#define UNMODEL_MISS(output_ptr) {			\
+    WK_word missed_word = *(next_full_word++);		\
+    DICT_UPDATE(missed_word);				\
+    *(output_ptr) = missed_word;			\
+  }
+#if !defined WK_FUSED
+/*
+ * Any tag but a miss as a partial match, with its dictionary index and low bits at the given pointers: an exact match pastes in
+ * the entry's own low bits, and a zero pastes them into its entry unchanged but writes a zero and leaves the entry where it is.
+ * A zero's dictionary index is that of the tag after it, or whatever follows the indices, hence the mask.
+ */
+#define UNMODEL_HIT(output_ptr,tag,dict_index_ptr,low_bits_ptr) {	\
+    WK_word is_zero    = TAG_IS_ZERO(tag);				\
+    WK_word paste_mask = -(WK_word)TAG_HAS_LOW_BITS(tag) & LOW_BITS_MASK; \
+    dictionary_element_s* dict_ptr = dictionary + (*(dict_index_ptr) & (DICTIONARY_SIZE - 1)); \
+    WK_word dict_entry = DICT_GET_VALUE(dict_ptr);			\
+    dict_entry = (dict_entry & ~paste_mask) | (*(low_bits_ptr) & paste_mask); \
+    *(output_ptr) = dict_entry & (is_zero - 1);				\
+    DICT_SET_VALUE(dict_ptr, dict_entry);				\
+    DICT_MOVE_TO_FRONT_IF(dict_ptr, !is_zero);				\
+  }
+#endif /* !WK_FUSED */
+/* ============================================================================================================================== */
+/* ============================================================================================================================== */
+/* CLASSIFICATION FUNCTIONS */
+#if defined WK_MODEL_RUNS
+/**
+ * Modeling runs through a page in blocks of up to 64 words.  Classifying a block marks, one bit per word, its zeros and the words
+ * whose high bits match those of the last nonzero word modeled before the block.  That word was left at the front of its set, in
+ * the set these words hash to, so each of them is an exact or a partial match with the entry that the nonzero word before it left
+ * there.  A block whose words are all marked can thus be encoded without consulting the dictionary.
+ **/
+#define CLASS_BLOCK_WORDS 64
+/**
+ * Classify num_words words, at most CLASS_BLOCK_WORDS, one at a time.
+ *
+ * \param high_bits The high bits of the last nonzero word before the block.
+ * \param anchored Whether there is such a word.  If not, only zeros are marked.
+ **/
+static void
+WK_classify_words (const WK_word* words,
+		   unsigned int num_words,
+		   WK_word high_bits,
+		   int anchored,
+		   uint64_t* zeros,
+		   uint64_t* matches) {
+  *zeros = *matches = 0;
+  for (unsigned int i = 0; i < num_words; ++i) {
+    *zeros   |= (uint64_t)(words[i] == 0) << i;
+    *matches |= (uint64_t)(anchored && HIGH_BITS(words[i]) == high_bits) << i;
+  }
+}
+#if defined WK_HAVE_AVX2
+/**
+ * Classify a whole block four words at a time, with the same results as WK_classify_words().
+ **/
+__attribute__((target("avx2")))
+static void
+WK_classify_words_avx2 (const WK_word* words,
+			WK_word high_bits,
+			int anchored,
+			uint64_t* zeros,
+			uint64_t* matches) {
+  const __m256i zero   = _mm256_setzero_si256();
+  const __m256i anchor = _mm256_set1_epi64x(anchored ? (long long)high_bits : -1);   /* Never the high bits of a word. */
+  uint64_t zero_bits = 0, match_bits = 0;
+  for (unsigned int i = 0; i < CLASS_BLOCK_WORDS; i += 4) {
+    __m256i word = _mm256_loadu_si256((const __m256i*)(words + i));
+    zero_bits  |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(word, zero))) << i;
+    match_bits |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(
+			_mm256_cmpeq_epi64(_mm256_srli_epi64(word, NUM_LOW_BITS), anchor))) << i;
+  }
+  *zeros   = zero_bits;
+  *matches = match_bits;
+}
+#endif /* WK_HAVE_AVX2 */
+/**
+ * Classify a block, with AVX2 if the CPU has it and the block is whole.
+ **/
+static void
+WK_classify_block (const WK_word* words,
+		   unsigned int num_words,
+		   WK_word high_bits,
+		   int anchored,
+		   uint64_t* zeros,
+		   uint64_t* matches) {
+#if defined WK_HAVE_AVX2
+  if (num_words == CLASS_BLOCK_WORDS && WK_CPU_HAS_AVX2()) {
+    WK_classify_words_avx2(words, high_bits, anchored, zeros, matches);
+    return;
+  }
+#endif
+  WK_classify_words(words, num_words, high_bits, anchored, zeros, matches);
+}
+#endif /* WK_MODEL_RUNS */
 /* ============================================================================================================================== */
 /* ============================================================================================================================== */
 /* PACKING and UNPACKING FUNCTIONS */
+/**
+ * The packer reads its source a word at a time, 'reps' words per packed word, so the entries it is given must be zero-filled to a
+ * whole number of such groups.  Otherwise whatever follows them ends up in the last packed word, and the output is not repeatable.
+ **/
+#define PACKING_GROUP(entry_type,bits_per_value) \
+  (((sizeof(entry_type) * BITS_PER_BYTE) / (bits_per_value)) * (BYTES_PER_WORD / sizeof(entry_type)))
 /**
  * Pack values in some loose array representation into a tight array of words, with multiple values per word.
  *
@@ -833,46 +1224,445 @@ WK_unpack_bits (WK_word* src_buf,
   }
   return dest_next;
 }
+/**
+ * Specialized packers.  WK_compress() and WK_decompress() pack and unpack three fields, each with a fixed number of bits per value
+ * and unpacked entry size, so each field gets a pair of functions in which 'reps' is a constant and the loops over it unroll.  For
+ * the fields that pack two to four source words into each packed word (all three, with the default dictionary and low bits),
+ * AVX2 versions do four packed words at a time.  They are chosen at runtime, when the CPU has AVX2.  The packed format is
+ * the same whichever is used.
+ **/
+#define PACKING_REPS(entry_type,bits_per_value) ((sizeof(entry_type) * BITS_PER_BYTE) / (bits_per_value))
+#if defined WK_HAVE_AVX2 && !defined WK_FUSED
+/**
+ * Pack as WK_pack_bits() does, four packed words at a time, where reps is 2, 3 or 4.
+ **/
+__attribute__((target("avx2")))
+static WK_word*
+WK_pack_bits_avx2 (WK_word* src_buf,
+		   WK_word* src_end,
+		   WK_word* dest_buf,
+		   unsigned int bits_per_value,
+		   unsigned int reps) {
+  WK_word* src_next  = src_buf;
+  WK_word* dest_next = dest_buf;
+  if (reps == 4) {
+    /* Shift each source word into place, then OR each run of four lanes into one: a transpose, folded as it goes. */
+    const __m256i shifts = _mm256_setr_epi64x(0, bits_per_value, 2 * bits_per_value, 3 * bits_per_value);
+    for (; src_next + 16 <= src_end; src_next += 16, dest_next += 4) {
+      __m256i a  = _mm256_sllv_epi64(_mm256_loadu_si256((const __m256i*)(src_next + 0)), shifts);
+      __m256i b  = _mm256_sllv_epi64(_mm256_loadu_si256((const __m256i*)(src_next + 4)), shifts);
+      __m256i c  = _mm256_sllv_epi64(_mm256_loadu_si256((const __m256i*)(src_next + 8)), shifts);
+      __m256i d  = _mm256_sllv_epi64(_mm256_loadu_si256((const __m256i*)(src_next + 12)), shifts);
+      __m256i ab = _mm256_or_si256(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b));
+      __m256i cd = _mm256_or_si256(_mm256_unpacklo_epi64(c, d), _mm256_unpackhi_epi64(c, d));
+      _mm256_storeu_si256((__m256i*)dest_next, _mm256_or_si256(_mm256_permute2x128_si256(ab, cd, 0x20),
+								 _mm256_permute2x128_si256(ab, cd, 0x31)));
+    }
+  } else if (reps == 3) {
+    /* Gather words 0, 3, 6, 9 (then 1, 4, ... and 2, 5, ...) of each twelve into a vector with a blend and a permutation. */
+    const __m128i shift = _mm_cvtsi32_si128(bits_per_value);
+    for (; src_next + 12 <= src_end; src_next += 12, dest_next += 4) {
+      __m256i v0 = _mm256_loadu_si256((const __m256i*)(src_next + 0));
+      __m256i v1 = _mm256_loadu_si256((const __m256i*)(src_next + 4));
+      __m256i v2 = _mm256_loadu_si256((const __m256i*)(src_next + 8));
+      __m256i a  = _mm256_blend_epi32(_mm256_blend_epi32(v0, v1, 0x30), v2, 0x0c);
+      __m256i b  = _mm256_blend_epi32(_mm256_blend_epi32(v1, v0, 0x0c), v2, 0x30);
+      __m256i c  = _mm256_blend_epi32(_mm256_blend_epi32(v2, v1, 0x0c), v0, 0x30);
+      a = _mm256_permute4x64_epi64(a, _MM_SHUFFLE(1, 2, 3, 0));
+      b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(2, 3, 0, 1));
+      c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(3, 0, 1, 2));
+      _mm256_storeu_si256((__m256i*)dest_next, _mm256_or_si256(a, _mm256_sll_epi64(_mm256_or_si256(b, _mm256_sll_epi64(c, shift)),
+										    shift)));
+    }
+  } else {
+    const __m256i shifts = _mm256_setr_epi64x(0, bits_per_value, 0, bits_per_value);
+    for (; src_next + 8 <= src_end; src_next += 8, dest_next += 4) {
+      __m256i a  = _mm256_sllv_epi64(_mm256_loadu_si256((const __m256i*)(src_next + 0)), shifts);
+      __m256i b  = _mm256_sllv_epi64(_mm256_loadu_si256((const __m256i*)(src_next + 4)), shifts);
+      __m256i ab = _mm256_or_si256(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b));
+      _mm256_storeu_si256((__m256i*)dest_next, _mm256_permute4x64_epi64(ab, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+  }
+  return WK_pack_bits(src_next, src_end, dest_next, bits_per_value, reps * bits_per_value);
+}
+/**
+ * Unpack as WK_unpack_bits() does, where reps is 2, 3 or 4.
+ **/
+__attribute__((target("avx2")))
+static WK_word*
+WK_unpack_bits_avx2 (WK_word* src_buf,
+		     WK_word* src_end,
+		     WK_word* dest_buf,
+		     unsigned int bits_per_value,
+		     unsigned int reps,
+		     WK_word packing_mask) {
+  WK_word*      src_next  = src_buf;
+  WK_word*      dest_next = dest_buf;
+  const __m256i mask      = _mm256_set1_epi64x(packing_mask);
+  if (reps == 4) {
+    const __m256i shifts = _mm256_setr_epi64x(0, bits_per_value, 2 * bits_per_value, 3 * bits_per_value);
+    for (; src_next < src_end; src_next += 1, dest_next += 4) {
+      __m256i packed = _mm256_set1_epi64x(*src_next);
+      _mm256_storeu_si256((__m256i*)dest_next, _mm256_and_si256(_mm256_srlv_epi64(packed, shifts), mask));
+    }
+  } else if (reps == 3) {
+    /* The inverse of the packer's gather: each permutation is its own inverse, and the blends put the words back in order. */
+    const __m128i shift = _mm_cvtsi32_si128(bits_per_value);
+    for (; src_next + 4 <= src_end; src_next += 4, dest_next += 12) {
+      __m256i packed = _mm256_loadu_si256((const __m256i*)src_next);
+      __m256i a = _mm256_and_si256(packed, mask);
+      __m256i b = _mm256_and_si256(_mm256_srl_epi64(packed, shift), mask);
+      __m256i c = _mm256_and_si256(_mm256_srl_epi64(_mm256_srl_epi64(packed, shift), shift), mask);
+      a = _mm256_permute4x64_epi64(a, _MM_SHUFFLE(1, 2, 3, 0));
+      b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(2, 3, 0, 1));
+      c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(3, 0, 1, 2));
+      _mm256_storeu_si256((__m256i*)(dest_next + 0), _mm256_blend_epi32(_mm256_blend_epi32(a, b, 0x0c), c, 0x30));
+      _mm256_storeu_si256((__m256i*)(dest_next + 4), _mm256_blend_epi32(_mm256_blend_epi32(b, c, 0x0c), a, 0x30));
+      _mm256_storeu_si256((__m256i*)(dest_next + 8), _mm256_blend_epi32(_mm256_blend_epi32(c, a, 0x0c), b, 0x30));
+    }
+  } else {
+    const __m256i shifts = _mm256_setr_epi64x(0, bits_per_value, 0, bits_per_value);
+    for (; src_next + 2 <= src_end; src_next += 2, dest_next += 4) {
+      __m256i packed = _mm256_permute4x64_epi64(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)src_next)),
+						_MM_SHUFFLE(1, 1, 0, 0));
+      _mm256_storeu_si256((__m256i*)dest_next, _mm256_and_si256(_mm256_srlv_epi64(packed, shifts), mask));
+    }
+  }
+  return WK_unpack_bits(src_next, src_end, dest_next, bits_per_value, reps * bits_per_value, packing_mask);
+}
+#define PACK_BITS_AVX2(reps,bits_per_value) {						\
+    if ((reps >= 2 && reps <= 4) && WK_CPU_HAS_AVX2()) {				\
+      return WK_pack_bits_avx2(src_buf, src_end, dest_buf, bits_per_value, reps);	\
+    }											\
+  }
+#define UNPACK_BITS_AVX2(reps,bits_per_value,packing_mask) {					\
+    if ((reps >= 2 && reps <= 4) && WK_CPU_HAS_AVX2()) {					\
+      return WK_unpack_bits_avx2(src_buf, src_end, dest_buf, bits_per_value, reps, packing_mask); \
+    }												\
+  }
+#else
+#define PACK_BITS_AVX2(reps,bits_per_value)
+#define UNPACK_BITS_AVX2(reps,bits_per_value,packing_mask)
+#endif /* WK_HAVE_AVX2 && !WK_FUSED */
+/**
+ * Define WK_pack_<field>() and WK_unpack_<field>(), with the arguments and results of WK_pack_bits() and WK_unpack_bits() less
+ * those that are fixed for the field.
+ **/
+#define DEFINE_PACKING_FUNCTIONS(field,bits_per_value,entry_type,packing_mask)	\
+  static WK_word*							\
+  WK_pack_##field (WK_word* src_buf,					\
+		   WK_word* src_end,					\
+		   WK_word* dest_buf) {					\
+    const unsigned int reps = PACKING_REPS(entry_type, bits_per_value); \
+    WK_word* src_next  = src_buf;					\
+    WK_word* dest_next = dest_buf;					\
+    PACK_BITS_AVX2(reps, bits_per_value);				\
+    for (; src_next < src_end; src_next += reps, ++dest_next) {	\
+      WK_word temp = src_next[0];					\
+      for (unsigned int i = 1; i < reps; ++i) {				\
+	temp |= src_next[i] << (i * (bits_per_value));			\
+      }									\
+      *dest_next = temp;						\
+    }									\
+    return dest_next;							\
+  }									\
+  static WK_word*							\
+  WK_unpack_##field (WK_word* src_buf,					\
+		     WK_word* src_end,					\
+		     WK_word* dest_buf) {				\
+    const unsigned int reps = PACKING_REPS(entry_type, bits_per_value); \
+    WK_word* src_next  = src_buf;					\
+    WK_word* dest_next = dest_buf;					\
+    UNPACK_BITS_AVX2(reps, bits_per_value, packing_mask);		\
+    for (; src_next < src_end; ++src_next, dest_next += reps) {	\
+      WK_word temp = *src_next;						\
+      for (unsigned int i = 0; i < reps; ++i) {				\
+	dest_next[i] = (temp >> (i * (bits_per_value))) & (packing_mask); \
+      }									\
+    }									\
+    return dest_next;							\
+  }
+#if !defined WK_FUSED
+DEFINE_PACKING_FUNCTIONS(tags,         NUM_TAG_BITS,        WK_unpacked_tags_t,       TAG_PACKING_MASK)
+DEFINE_PACKING_FUNCTIONS(dict_indices, NUM_DICT_INDEX_BITS, WK_unpacked_dict_index_t, DICT_INDEX_PACKING_MASK)
+DEFINE_PACKING_FUNCTIONS(low_bits,     NUM_LOW_BITS,        WK_unpacked_low_bits_t,   LOW_BITS_PACKING_MASK)
+#else
+/**
+ * Packing one value at a time.  A packed word holds a PACKING_GROUP of values, laid out as the packers above would lay them out
+ * from an array of entry_type: value number 'count' of a field goes into packed word count / PACKING_GROUP, at bit
+ * PACKED_SHIFT(count % PACKING_GROUP).  Each field being packed or unpacked keeps the first packed word, the number of values so
+ * far and, when packing, the word being filled, in variables named after the field.
+ *
+ * None of these branch, and the only state carried from one value to the next is the count and the word being filled.  The word
+ * is stored after every value, so that it is in place whenever the field ends.
+ **/
+#define PACKED_ENTRIES_PER_WORD(entry_type) (BYTES_PER_WORD / sizeof(entry_type))
+#define PACKED_SHIFT(position,entry_type,bits_per_value)				\
+  (((position) % PACKED_ENTRIES_PER_WORD(entry_type)) * sizeof(entry_type) * BITS_PER_BYTE +	\
+   ((position) / PACKED_ENTRIES_PER_WORD(entry_type)) * (bits_per_value))
+#define PACK_FIELD_DECLARE(field,start)		\
+  WK_word* const field##_start = (start);	\
+  unsigned int   field##_count = 0;		\
+  WK_word        field##_word  = 0;
+#define UNPACK_FIELD_DECLARE(field,start)	\
+  const WK_word* const field##_start = (start);	\
+  unsigned int         field##_count = 0;
+#define PACK_FIELD(field,entry_type,bits_per_value,value,condition) {	\
+    unsigned int position = field##_count % PACKING_GROUP(entry_type, bits_per_value); \
+    field##_word |= ((WK_word)(value) & -(WK_word)(condition)) << PACKED_SHIFT(position, entry_type, bits_per_value); \
+    field##_start[field##_count / PACKING_GROUP(entry_type, bits_per_value)] = field##_word; \
+    field##_count += (condition);					\
+    field##_word  &= -(WK_word)(field##_count % PACKING_GROUP(entry_type, bits_per_value) != 0); \
+  }
+/* Pack count zeros, at least one: they leave the word being filled as it is, and the words after it zero. */
+#define PACK_FIELD_ZEROS(field,entry_type,bits_per_value,count) {	\
+    unsigned int first_word = field##_count / PACKING_GROUP(entry_type, bits_per_value); \
+    field##_count += (count);						\
+    field##_start[first_word] = field##_word;				\
+    for (unsigned int word_number = first_word + 1;			\
+	 word_number <= (field##_count - 1) / PACKING_GROUP(entry_type, bits_per_value); ++word_number) { \
+      field##_start[word_number] = 0;					\
+    }									\
+    if (field##_count / PACKING_GROUP(entry_type, bits_per_value) != first_word) { \
+      field##_word = 0;							\
+    }									\
+  }
+/**
+ * The bits of the values at positions [0, position) of a packed word.  The packing mask covers one value in every entry.
+ **/
+static inline WK_word
+WK_packed_prefix_mask (unsigned int position,
+		       unsigned int entries_per_word,
+		       unsigned int bits_per_value,
+		       WK_word packing_mask) {
+  WK_word      mask = 0;
+  unsigned int rep  = 0;
+  for (; rep < position / entries_per_word; ++rep) {
+    mask |= packing_mask << (rep * bits_per_value);
+  }
+  if (position % entries_per_word != 0) {
+    mask |= (packing_mask & (((WK_word)1 << (position % entries_per_word * (BITS_PER_WORD / entries_per_word))) - 1)) <<
+      (rep * bits_per_value);
+  }
+  return mask;
+}
+#define PACKED_PREFIX_MASK(position,entry_type,bits_per_value,packing_mask) \
+  WK_packed_prefix_mask((position), PACKED_ENTRIES_PER_WORD(entry_type), (bits_per_value), (packing_mask))
+/* Pack count copies of a value, a packed word at a time. */
+#define PACK_FIELD_REPEAT(field,entry_type,bits_per_value,packing_mask,value,count) { \
+    const WK_word all_values = PACKED_PREFIX_MASK(PACKING_GROUP(entry_type, bits_per_value), entry_type, bits_per_value, packing_mask); \
+    const WK_word repeated   = (WK_word)(value) * (all_values / (((WK_word)1 << (bits_per_value)) - 1)); \
+    for (unsigned int left = (count); left > 0;) {			\
+      unsigned int position = field##_count % PACKING_GROUP(entry_type, bits_per_value); \
+      unsigned int taken    = PACKING_GROUP(entry_type, bits_per_value) - position < left ? \
+	PACKING_GROUP(entry_type, bits_per_value) - position : left;	\
+      field##_word |= repeated & PACKED_PREFIX_MASK(position + taken, entry_type, bits_per_value, packing_mask) & \
+	~PACKED_PREFIX_MASK(position, entry_type, bits_per_value, packing_mask); \
+      field##_start[field##_count / PACKING_GROUP(entry_type, bits_per_value)] = field##_word; \
+      field##_count += taken;						\
+      left          -= taken;						\
+      field##_word  &= -(WK_word)(field##_count % PACKING_GROUP(entry_type, bits_per_value) != 0); \
+    }									\
+  }
+/* The end of the packed field.  A partly filled last word was stored with its unused positions zero. */
+#define PACK_FIELD_END(field,entry_type,bits_per_value) \
+  (field##_start + (field##_count + PACKING_GROUP(entry_type, bits_per_value) - 1) / PACKING_GROUP(entry_type, bits_per_value))
+#define UNPACK_FIELD(field,entry_type,bits_per_value,value) {		\
+    value = (field##_start[field##_count / PACKING_GROUP(entry_type, bits_per_value)] >> \
+	     PACKED_SHIFT(field##_count % PACKING_GROUP(entry_type, bits_per_value), entry_type, bits_per_value)) & \
+      (((WK_word)1 << (bits_per_value)) - 1);				\
+    ++field##_count;							\
+  }
+#endif /* WK_FUSED */
+/* ============================================================================================================================== */
+/* ============================================================================================================================== */
+/* SCRATCH MEMORY */
+/**
+ * The page-sized arrays that a call works in: the unpacked tags, dictionary indices and low bits between modeling and packing or
+ * unpacking and unmodeling, or, when coding is fused, the packed dictionary indices and low bits that the compressor moves into
+ * place once the full words are written.  WK_compress() and WK_decompress() make them on the stack; a WK_context holds them for
+ * as many calls as it is used for.  The sizes are in entries.
+ **/
+#if defined WK_FUSED
+#define SCRATCH_DICT_INDICES_SIZE(num_words) ((num_words) / PACKING_GROUP(WK_unpacked_dict_index_t, NUM_DICT_INDEX_BITS) + 1)
+#define SCRATCH_LOW_BITS_SIZE(num_words)     ((num_words) / PACKING_GROUP(WK_unpacked_low_bits_t, NUM_LOW_BITS) + 1)
+typedef struct {
+  WK_word* packed_dict_indices;
+  WK_word* packed_low_bits;
+} WK_scratch;
+#else
+#define SCRATCH_TAGS_SIZE(num_words)         (num_words)
+#define SCRATCH_DICT_INDICES_SIZE(num_words) ((num_words) + PACKING_GROUP(WK_unpacked_dict_index_t, NUM_DICT_INDEX_BITS))
+#define SCRATCH_LOW_BITS_SIZE(num_words)     ((num_words) + PACKING_GROUP(WK_unpacked_low_bits_t, NUM_LOW_BITS))
+typedef struct {
+  WK_unpacked_tags_t*       tags;
+  WK_unpacked_dict_index_t* dict_indices;
+  WK_unpacked_low_bits_t*   low_bits;
+} WK_scratch;
+#endif /* WK_FUSED */
+/**
+ * Each of a context's arrays starts on a cache line of its own.
+ **/
+#define WK_CACHE_LINE_BYTES 64
+#define WK_CACHE_LINE_ROUND(bytes) (((bytes) + WK_CACHE_LINE_BYTES - 1) & ~(size_t)(WK_CACHE_LINE_BYTES - 1))
+struct WK_context_struct {
+  unsigned int max_words;
+  WK_scratch   scratch;
+  void*        memory;    /* from which the arrays are carved */
+};
+/* ============================================================================================================================== */
+/* ============================================================================================================================== */
+/* MODELING */
+/**
+ * MODEL_PAGE... model the num_words words at src_buf against the dictionary, which is made and initialized, recording the results
+ * with RECORD... (see above).  Compression and WK_compressed_size() record them differently, but model alike, and so agree on every
+ * page.  Every BUDGET_CHECK_WORDS words, CHECK_BUDGET says whether to go on.
+ *
+ * Zeros never touch the dictionary: the decompressor writes them without looking at it, so the compressor must not look them up
+ * either, lest the two dictionaries' LRU orders drift apart.
+ **/
+#if defined WK_MODEL_RUNS
+/*
+ * The anchor is the dictionary entry of the last nonzero word modeled.  Words of a wholly classified block are recorded against it
+ * without branching on their kind; other blocks are modeled word by word, still skipping the lookup for words that match the
+ * anchor.  The anchor's value is only written back when a block is done with it.
+ */
+#define MODEL_PAGE()							\
+  {									\
+    static const WK_unpacked_tags_t anchored_tags[2][2] = {{PARTIAL_TAG, EXACT_TAG},   /* [zero][exact] */ \
+							    {ZERO_TAG,    ZERO_TAG}}; \
+    dictionary_element_s*    anchor_ptr   = NULL;			\
+    WK_unpacked_dict_index_t anchor_index = 0;				\
+    WK_word                  anchor_value = 0;				\
+    for (unsigned int block = 0; block < num_words; block += CLASS_BLOCK_WORDS) { \
+      WK_word*     block_words = src_buf + block;			\
+      unsigned int block_size  = num_words - block < CLASS_BLOCK_WORDS ? num_words - block : CLASS_BLOCK_WORDS; \
+      uint64_t     all         = block_size == 64 ? ~(uint64_t)0 : ((uint64_t)1 << block_size) - 1; \
+      uint64_t     zeros, matches;					\
+      WK_classify_block(block_words, block_size, HIGH_BITS(anchor_value), anchor_ptr != NULL, &zeros, &matches); \
+      if (zeros == all) {						\
+	RECORD_ZEROS(block_size);					\
+      } else if ((zeros | matches) == all) {				\
+	unsigned int num_nonzero = 0;					\
+	for (unsigned int k = 0; k < block_size; ++k) {			\
+	  WK_word      input_word = block_words[k];			\
+	  unsigned int is_zero    = (zeros >> k) & 1;			\
+	  unsigned int is_exact   = input_word == anchor_value;		\
+	  RECORD_TAG(anchored_tags[is_zero][is_exact]);			\
+	  RECORD_LOW_BITS_IF(LOW_BITS(input_word), !is_zero & !is_exact); \
+	  num_nonzero += !is_zero;					\
+	  anchor_value = is_zero ? anchor_value : input_word;		\
+	}								\
+	RECORD_DICT_INDEX_REPEAT(anchor_index, num_nonzero);		\
+	DICT_SET_VALUE(anchor_ptr, anchor_value);			\
+      } else {								\
+	for (unsigned int k = 0; k < block_size; ++k) {			\
+	  WK_word input_word = block_words[k];				\
+	  if (input_word == 0) {					\
+	    RECORD_ZERO;						\
+	  } else if (anchor_ptr != NULL && HIGH_BITS(input_word) == HIGH_BITS(anchor_value)) { \
+	    if (input_word == anchor_value) {				\
+	      RECORD_EXACT(anchor_index);				\
+	    } else {							\
+	      RECORD_PARTIAL(anchor_index, LOW_BITS(input_word));	\
+	      DICT_SET_VALUE(anchor_ptr, input_word);			\
+	      anchor_value = input_word;				\
+	    }								\
+	  } else {							\
+	    MODEL_NONZERO_WORD(input_word, anchor_ptr);			\
+	    anchor_index = anchor_ptr - dictionary;			\
+	    anchor_value = input_word;					\
+	  }								\
+	}								\
+      }									\
+      CHECK_BUDGET;							\
+    }									\
+  }
+#else
+#define MODEL_PAGE()							\
+  {									\
+    WK_word* end_of_input  = src_buf + num_words;			\
+    int      stride_offset = 0;						\
+    while (stride_offset < WK_STRIDE) {					\
+      WK_word* next_input_word = src_buf + stride_offset;		\
+      while (next_input_word < end_of_input) {				\
+	WK_word* end_of_check = end_of_input - next_input_word > BUDGET_CHECK_WORDS * WK_STRIDE ? \
+	  next_input_word + BUDGET_CHECK_WORDS * WK_STRIDE : end_of_input; \
+	for (; next_input_word < end_of_check; next_input_word += WK_STRIDE) { \
+	  WK_word input_word = *next_input_word;			\
+	  if (input_word == 0) {					\
+	    RECORD_ZERO;						\
+	  } else {							\
+	    dictionary_element_s* entry_ptr;				\
+	    MODEL_NONZERO_WORD(input_word, entry_ptr);			\
+	    (void)entry_ptr; /* Only the runs model uses the entry. */	\
+	  }								\
+	}								\
+	CHECK_BUDGET;							\
+      } /* while next_input_word */					\
+      ++stride_offset;							\
+    } /* while stride_offset */						\
+  }
+#endif /* WK_MODEL_RUNS */
 /* ============================================================================================================================== */
 /* ============================================================================================================================== */
 /* COMPRESSION AND DECOMPRESSION FUNCTIONS */
 /**
- * \brief Compress a source buffer into a destination buffer.
+ * \brief Compress a source buffer into a destination buffer, using the given scratch memory.
  * \param src_buf The source buffer of uncompressed data.
  * \param dst_buf The destination buffer that will contain the compressed representation.
  * \param num_words The number of words in the source to compress.
- * \return A pointer to the end of the destination buffer, marking the end of the compressed reprensetation generated.
+ * \param scratch Arrays of at least the SCRATCH_..._SIZE(num_words) entries.
+ * \param max_bytes The budget: the most bytes the compressed representation may take, or WK_NO_BUDGET.  It bounds the size of
+ *        the result, not the bytes written: full patterns go to the destination as they are modeled, the budget is only checked
+ *        every BUDGET_CHECK_WORDS words, and fused packing lays out the whole tag area first.  The destination must still hold
+ *        MAX_COMPRESSED_BYTES.
+ * \return A pointer to the end of the destination buffer, marking the end of the compressed reprensetation generated, or NULL if it
+ *         would take more than max_bytes.  Modeling stops as soon as that is certain, leaving the destination buffer partly
+ *         written, possibly beyond max_bytes.
  **/
-WK_word*
-WK_compress (WK_word* src_buf,
-	     WK_word* dest_buf,
-	     unsigned int num_words) {
+static WK_word*
+WK_compress_scratch (WK_word* src_buf,
+		     WK_word* dest_buf,
+		     unsigned int num_words,
+		     const WK_scratch* scratch,
+		     unsigned int max_bytes) {
+  const unsigned int max_words = max_bytes / BYTES_PER_WORD;
   /* ============================================================== */
   /* PHASE 1: Model by matching against a recency-based dictionary. */
   /* ============================================================== */
   /* Create the dictionary. */
   DICT_CREATE();
-  /*
-   * Arrays that hold output data in intermediate form during modeling and whose contents are packed into the actual output after
-   * modeling.
-   */
-  WK_unpacked_tags_t       temp_tags        [num_words];
-  WK_unpacked_dict_index_t temp_dict_indices[num_words];
-  WK_unpacked_low_bits_t   temp_low_bits    [num_words];
   /*
    * Keep track of how far into the compressed buffer we've gone.
    */
   WK_word* boundary_tmp;
   /*
-   * Fill pointers for filling temporary arrays (of queue positions and low bits, unpacked) during encoding.  Full words go straight
-   * to the destination buffer area reserved for them.  (Right after where the tags go.)
+   * Full words go straight to the destination buffer area reserved for them.  (Right after where the tags go.)
+   */
+  WK_word* next_full_patt = dest_buf + FULL_PATTERNS_AREA_OFFSET(num_words);
+#if defined WK_FUSED
+  /*
+   * Tags are packed straight into the tags area.  Dictionary indices and low bits are packed into these arrays, to be copied after
+   * the full words once their number is known.
+   */
+  WK_word* const packed_dict_indices = scratch->packed_dict_indices;
+  WK_word* const packed_low_bits     = scratch->packed_low_bits;
+  PACK_FIELD_DECLARE(tags,         dest_buf + HEADER_AREA_SIZE);
+  PACK_FIELD_DECLARE(dict_indices, packed_dict_indices);
+  PACK_FIELD_DECLARE(low_bits,     packed_low_bits);
+#else
+  /*
+   * Arrays that hold output data in intermediate form during modeling and whose contents are packed into the actual output after
+   * modeling, and pointers for filling them.
    */
-  WK_word*                  next_full_patt  = dest_buf + FULL_PATTERNS_AREA_OFFSET(num_words);
+  WK_unpacked_tags_t* const       temp_tags         = scratch->tags;
+  WK_unpacked_dict_index_t* const temp_dict_indices = scratch->dict_indices;
+  WK_unpacked_low_bits_t* const   temp_low_bits     = scratch->low_bits;
   WK_unpacked_tags_t*       next_tag        = temp_tags;
   WK_unpacked_dict_index_t* next_dict_index = temp_dict_indices;
   WK_unpacked_low_bits_t*   next_low_bits   = temp_low_bits;
-  WK_word*                  end_of_input    = src_buf + num_words;
-  int                       stride_offset   = 0;
+#endif /* WK_FUSED */
   
   /* Preload the dictionary.  Candidate for loop unrolling.*/
   DICT_INITIALIZE();
@@ -881,35 +1671,28 @@ WK_compress (WK_word* src_buf,
   DEBUG_PRINT_VAL("dictionary     = ", (WK_word)dictionary);
   DEBUG_PRINT_VAL("dest_buf       = ", (WK_word)dest_buf);
   DEBUG_PRINT_VAL("next_full_patt = ", (WK_word)next_full_patt);
-  while (stride_offset < WK_STRIDE) {
-    WK_word* next_input_word = src_buf + stride_offset;
-    while (next_input_word < end_of_input) {
-      /* Attempt to look up this word in the dictionary. */
-      WK_word input_word = *next_input_word;
-      DICT_LOOKUP(input_word);
-      /**
-       * Determine what kind of value we have, as well as what kind of dictionary hit (or not), in order to determine what modeling
-       * to record.
-       **/
-      if (input_word == dict_word) {
-	RECORD_EXACT(dict_index);
-	DICT_MOVE_TO_FRONT(dict_ptr);
-      } else if (input_word == 0) {
-	RECORD_ZERO;
-      } else {
-	WK_word input_high_bits = HIGH_BITS(input_word);
-	if (input_high_bits == HIGH_BITS(dict_word)) {
-	  RECORD_PARTIAL(dict_index, LOW_BITS(input_word));
-	} else {
-	  RECORD_MISS(input_word);
-	}
-	DICT_SET_VALUE(dict_ptr, input_word);
-	DICT_MOVE_TO_FRONT(dict_ptr);
-      }
-      next_input_word += WK_STRIDE;
-    } /* while next_input_word */
-    ++stride_offset;
-  } /* while stride_offset */
+  MODEL_PAGE();
+#if defined WK_FUSED
+  /* ===================================================================================================== */
+  /* PHASE 2: Finish the packed fields, and move the indices and low bits into place after the full words. */
+  /* ===================================================================================================== */
+  {
+    WK_word* dict_indices_end = PACK_FIELD_END(dict_indices, WK_unpacked_dict_index_t, NUM_DICT_INDEX_BITS);
+    WK_word* low_bits_end     = PACK_FIELD_END(low_bits, WK_unpacked_low_bits_t, NUM_LOW_BITS);
+    DEBUG_PRINT_MSG("AFTER MODELING in WK_compress()\n");
+    DEBUG_PRINT_VAL("num dict indices = ", (WK_word)dict_indices_count);
+    DEBUG_PRINT_VAL("num low bits     = ", (WK_word)low_bits_count);
+    DEBUG_PRINT_VAL("num full patts   = ", (WK_word)(next_full_patt - (dest_buf + FULL_PATTERNS_AREA_OFFSET(num_words))));
+    SET_NUM_WORDS(dest_buf,num_words);
+    SET_INDEX_AREA_START(dest_buf,next_full_patt);
+    memcpy(next_full_patt, packed_dict_indices, (dict_indices_end - packed_dict_indices) * sizeof(WK_word));
+    boundary_tmp = next_full_patt + (dict_indices_end - packed_dict_indices);
+    SET_LOW_BITS_AREA_START(dest_buf,boundary_tmp);
+    memcpy(boundary_tmp, packed_low_bits, (low_bits_end - packed_low_bits) * sizeof(WK_word));
+    boundary_tmp += low_bits_end - packed_low_bits;
+  }
+  SET_LOW_BITS_AREA_END(dest_buf,boundary_tmp);
+#else
   DEBUG_PRINT_MSG("AFTER MODELING in WK_compress()\n");
   DEBUG_PRINT_VAL("num tags         = ", (WK_word)(next_tag - temp_tags));
   DEBUG_PRINT_VAL("num dict indices = ", (WK_word)(next_dict_index - temp_dict_indices));
@@ -948,75 +1731,74 @@ WK_compress (WK_word* src_buf,
    * Pack the tags into the tags area, between the page header and the full words area.  We don't pad for the packer because we
    * assume that the compressed page's size (in bytes) is a multiple of the word size.
    */     
-  boundary_tmp = WK_pack_bits((WK_word*)temp_tags,
+  boundary_tmp = WK_pack_tags((WK_word*)temp_tags,
 			      (WK_word*)next_tag,
-			      dest_buf + HEADER_AREA_SIZE,
-			      NUM_TAG_BITS,
-			      sizeof(WK_unpacked_tags_t) * BITS_PER_BYTE);
+			      dest_buf + HEADER_AREA_SIZE);
   /*
-   * Pack the dictionary indices into the area just after the full words.  We have to round up the source region to the number of
-   * 'reps' (as calculated in the bit packing/unpacking functions), filling in zeroes in the trailing entries to avoid ill effects
-   * during packing from extraneous non-zero values.
+   * Pack the dictionary indices into the area just after the full words.  We have to round up the source region to a whole
+   * PACKING_GROUP, filling in zeroes in the trailing entries to avoid ill effects during packing from extraneous non-zero values.
    */
   {
     unsigned int num_entries = next_dict_index - temp_dict_indices;
-    unsigned int reps = (sizeof(WK_unpacked_dict_index_t) * BITS_PER_BYTE) / NUM_DICT_INDEX_BITS;
-    while (num_entries % reps != 0) {
+    unsigned int group = PACKING_GROUP(WK_unpacked_dict_index_t, NUM_DICT_INDEX_BITS);
+    while (num_entries % group != 0) {
       *next_dict_index = 0;
       ++next_dict_index;
       ++num_entries;
     }
-    boundary_tmp = WK_pack_bits((WK_word*)temp_dict_indices,
-				(WK_word*)next_dict_index,
-				next_full_patt,
-				NUM_DICT_INDEX_BITS,
-				sizeof(WK_unpacked_dict_index_t) * BITS_PER_BYTE);
+    boundary_tmp = WK_pack_dict_indices((WK_word*)temp_dict_indices,
+					(WK_word*)next_dict_index,
+					next_full_patt);
     /* Record (into the header) where we stopped packing queue positions, which is where we will start packing low bits. */
     SET_LOW_BITS_AREA_START(dest_buf,boundary_tmp);
   }
   /*
-   * Pack the low bit patterns into the area just after the queue positions.  We have to round up the source region to a multiple of
-   * the number of words per packed together (the 'reps' in the packing/unpacking functions).  Zero-fill trailing entries to avoid
-   * ill effects during the packing.
+   * Pack the low bit patterns into the area just after the queue positions.  We have to round up the source region to a whole
+   * PACKING_GROUP.  Zero-fill trailing entries to avoid ill effects during the packing.
    */
   {
     unsigned int num_entries = next_low_bits - temp_low_bits;
-    unsigned int reps = (sizeof(WK_unpacked_low_bits_t) * BITS_PER_BYTE) / NUM_LOW_BITS;
-    while (num_entries % reps != 0) {
+    unsigned int group = PACKING_GROUP(WK_unpacked_low_bits_t, NUM_LOW_BITS);
+    while (num_entries % group != 0) {
       *next_low_bits = 0;
       ++next_low_bits;
       ++num_entries;
     }
-    boundary_tmp = WK_pack_bits((WK_word*)temp_low_bits,
-				(WK_word*)next_low_bits,
-				boundary_tmp,
-				NUM_LOW_BITS,
-				sizeof(WK_unpacked_low_bits_t) * BITS_PER_BYTE);
+    boundary_tmp = WK_pack_low_bits((WK_word*)temp_low_bits,
+				    (WK_word*)next_low_bits,
+				    boundary_tmp);
     SET_LOW_BITS_AREA_END(dest_buf,boundary_tmp);
   }
+#endif /* WK_FUSED */
   return boundary_tmp;
 }
 /**
- * \brief Decompress a source buffer into a destination buffer.
+ * \brief Decompress a source buffer into a destination buffer, using the given scratch memory.
  * \param src_buf The source buffer of compressed data.
  * \param dst_buf The destination buffer that will contain the uncompressed representation.
+ * \param num_words The number of words in the source, from its header.
+ * \param scratch Arrays of at least the SCRATCH_..._SIZE(num_words) entries.  Unused when coding is fused.
  * \return A pointer to the end of the destination buffer, marking the end of the uncompressed reprensetation generated.
  **/
-WK_word*
-WK_decompress (WK_word* src_buf,
-	       WK_word* dest_buf) {
+static WK_word*
+WK_decompress_scratch (WK_word* src_buf,
+		       WK_word* dest_buf,
+		       unsigned int num_words,
+		       const WK_scratch* scratch) {
   /* PHASE 1: Decode the packed representation of the compressed buffer. */
-  /* Make the dictionary (and any associated structured, e.g., hash lookup table). */
+  /* Make the dictionary. */
   DICT_CREATE();
-  /* Extract the number of uncompressed words to be processed from the compressed header. */
-  unsigned int num_words = GET_NUM_WORDS(src_buf);
+#if defined WK_FUSED
+  (void)scratch;
+#else
   /*
    * Arrays that hold output data in intermediate form during modeling and whose contents are packed into the actual output after
-   * modeling.
+   * modeling.  Whole packed words are unpacked, so the padding that the compressor packed comes back out.
    */
-  WK_unpacked_tags_t       temp_tags        [num_words];
-  WK_unpacked_dict_index_t temp_dict_indices[num_words];
-  WK_unpacked_low_bits_t   temp_low_bits    [num_words];
+  WK_unpacked_tags_t* const       temp_tags         = scratch->tags;
+  WK_unpacked_dict_index_t* const temp_dict_indices = scratch->dict_indices;
+  WK_unpacked_low_bits_t* const   temp_low_bits     = scratch->low_bits;
+#endif /* WK_FUSED */
   /* Preload the dictionary. */
   DICT_INITIALIZE();
   DEBUG_PRINT_MSG("\nIn WK_decompress\n");
@@ -1032,24 +1814,16 @@ WK_decompress (WK_word* src_buf,
       printf("  whole_words[%d] = 0x%" WORD_FORMAT_WIDTH PRIxWORD "\n", i, whole_words[i]);  
   }
 #endif // WK_DEBUG
-  WK_unpack_bits(TAGS_AREA_START(src_buf),
-                 TAGS_AREA_END(src_buf),
-		 (WK_word*)temp_tags,
-		 NUM_TAG_BITS,
-		 sizeof(WK_unpacked_tags_t) * BITS_PER_BYTE,
-		 TAG_PACKING_MASK);
-  WK_unpack_bits(INDEX_AREA_START(src_buf),
-		 INDEX_AREA_END(src_buf),
-		 (WK_word*)temp_dict_indices,
-		 NUM_DICT_INDEX_BITS,
-		 sizeof(WK_unpacked_dict_index_t) * BITS_PER_BYTE,
-		 DICT_INDEX_PACKING_MASK);
-  WK_unpack_bits(LOW_BITS_AREA_START(src_buf),
-		 LOW_BITS_AREA_END(src_buf),
-		 (WK_word*)temp_low_bits,
-		 NUM_LOW_BITS,
-		 sizeof(WK_unpacked_low_bits_t) * BITS_PER_BYTE,
-		 LOW_BITS_PACKING_MASK);
+#if !defined WK_FUSED
+  WK_unpack_tags(TAGS_AREA_START(src_buf),
+		 TAGS_AREA_END(src_buf),
+		 (WK_word*)temp_tags);
+  WK_unpack_dict_indices(INDEX_AREA_START(src_buf),
+			 INDEX_AREA_END(src_buf),
+			 (WK_word*)temp_dict_indices);
+  WK_unpack_low_bits(LOW_BITS_AREA_START(src_buf),
+		     LOW_BITS_AREA_END(src_buf),
+		     (WK_word*)temp_low_bits);
 #if WK_DEBUG
   {
     WK_word* whole_words  = src_buf + FULL_PATTERNS_AREA_OFFSET(num_words);
@@ -1067,77 +1841,112 @@ WK_decompress (WK_word* src_buf,
       printf("  whole_words[%d] = 0x%" WORD_FORMAT_WIDTH PRIxWORD "\n", i, whole_words[i]);  
   }
 #endif // WK_DEBUG
+#endif /* !WK_FUSED */
   
   /* PHASE 2: Unmodel.  Given the unpacked representation generated by the modeling, restore the original data. */
   DEBUG_PRINT_MSG("AFTER UNPACKING, about to enter main block \n");
   {
+#if defined WK_FUSED
+    /* The packed fields are read in place, a word at a time. */
+    UNPACK_FIELD_DECLARE(tags,         TAGS_AREA_START(src_buf));
+    UNPACK_FIELD_DECLARE(dict_indices, INDEX_AREA_START(src_buf));
+    UNPACK_FIELD_DECLARE(low_bits,     LOW_BITS_AREA_START(src_buf));
+#else
     register WK_unpacked_tags_t* next_tag        = temp_tags;
     WK_unpacked_dict_index_t*    next_dict_index = temp_dict_indices;
     WK_unpacked_low_bits_t*      next_low_bits   = temp_low_bits;
+    DEBUG_PRINT_VAL("next_tag         = ", (WK_word)next_tag);
+    DEBUG_PRINT_VAL("next_dict_index  = ", (WK_word)next_dict_index);
+    DEBUG_PRINT_VAL("next_low_bits    = ", (WK_word)next_low_bits);
+#endif /* WK_FUSED */
     WK_word*                     next_full_word  = FULL_WORD_AREA_START(src_buf);
     WK_word*                     next_output;
     WK_word*                     end_of_output   = dest_buf + num_words;
     int                          stride_offset   = 0;
-    DEBUG_PRINT_VAL("next_output      = ", (WK_word)next_output);
-    DEBUG_PRINT_VAL("next_tag         = ", (WK_word)next_tag);
-    DEBUG_PRINT_VAL("next_dict_index  = ", (WK_word)next_dict_index);
-    DEBUG_PRINT_VAL("next_low_bits    = ", (WK_word)next_low_bits);
     DEBUG_PRINT_VAL("next_full_word   = ", (WK_word)next_full_word);
     while (stride_offset < WK_STRIDE) {
     
       next_output = dest_buf + stride_offset;
+#if !defined WK_FUSED
+      while (end_of_output - next_output > (TAG_GROUP_SIZE - 1) * WK_STRIDE) {
+	if (end_of_output - next_output > (TAG_RUN_SIZE - 1) * WK_STRIDE) {
+	  uint64_t run;
+	  memcpy(&run, next_tag, sizeof(run));
+	  WK_word run_tag = next_tag[0];
+	  if (run == run_tag * TAG_RUN_BYTES) {
+	    switch (run_tag) {
+	    case ZERO_TAG:
+	      for (unsigned int i = 0; i < TAG_RUN_SIZE; ++i) {
+		UNMODEL_ZERO(next_output + i * WK_STRIDE);
+	      }
+	      break;
+	    case EXACT_TAG:
+	      for (unsigned int i = 0; i < TAG_RUN_SIZE; ++i) {
+		UNMODEL_EXACT(next_output + i * WK_STRIDE);
+	      }
+	      break;
+	    case PARTIAL_TAG:
+	      for (unsigned int i = 0; i < TAG_RUN_SIZE; ++i) {
+		UNMODEL_PARTIAL(next_output + i * WK_STRIDE);
+	      }
+	      break;
+	    case MISS_TAG:
+	      for (unsigned int i = 0; i < TAG_RUN_SIZE; ++i) {
+		UNMODEL_MISS(next_output + i * WK_STRIDE);
+	      }
+	      break;
+	    }
+	    next_tag    += TAG_RUN_SIZE;
+	    next_output += TAG_RUN_SIZE * WK_STRIDE;
+	    continue;
+	  }
+	}
+	unsigned int group;
+	READ_TAG_GROUP(group);
+	const WK_tag_group_s* tag_group = WK_tag_groups + group;
+	if (!tag_group->has_miss) {
+	  for (unsigned int i = 0; i < TAG_GROUP_SIZE; ++i) {
+	    UNMODEL_HIT(next_output + i * WK_STRIDE, next_tag[i], next_dict_index + tag_group->dict_index_offset[i],
+			next_low_bits + tag_group->low_bits_offset[i]);
+	  }
+	  next_dict_index += tag_group->dict_indices;
+	  next_low_bits   += tag_group->low_bits;
+	} else {
+	  /* Among misses, the other tags find their indices and low bits as a tag at a time would. */
+	  for (unsigned int i = 0; i < TAG_GROUP_SIZE; ++i) {
+	    WK_word tag = next_tag[i];
+	    if (TAG_IS_MISS(tag)) {
+	      UNMODEL_MISS(next_output + i * WK_STRIDE);
+	    } else {
+	      UNMODEL_HIT(next_output + i * WK_STRIDE, tag, next_dict_index, next_low_bits);
+	      next_dict_index += TAG_HAS_DICT_INDEX(tag);
+	      next_low_bits   += TAG_HAS_LOW_BITS(tag);
+	    }
+	  }
+	}
+	next_tag        += TAG_GROUP_SIZE;
+	next_output     += TAG_GROUP_SIZE * WK_STRIDE;
+      }
+#endif /* !WK_FUSED */
+      /* Unmodel a tag at a time: the tags after the last group, or every tag when coding is fused. */
       while (next_output < end_of_output) {
-	switch(*next_tag) {
-	case ZERO_TAG: {
-	  /*
-	   * It was just a zero.  The dictionary is unused; just append the zero to the decompressed buffer.
-	   */
-	  *next_output = 0;
+	WK_word tag;
+	READ_TAG(tag);
+	switch(tag) {
+	case ZERO_TAG:
+	  UNMODEL_ZERO(next_output);
 	  break;
-	}
-	case EXACT_TAG: {
-	  /*
-	   * For an exact match, just lookup the given dictionary entry and use its words.  Because the match was exact, no update to
-	   * the dictionary is needed.
-	   */
-	  dictionary_element_s* dict_ptr = dictionary + *(next_dict_index++);
-	  *next_output = DICT_GET_VALUE(dict_ptr);
-	  DICT_MOVE_TO_FRONT(dict_ptr);
+	case EXACT_TAG:
+	  UNMODEL_EXACT(next_output);
 	  break;
-	}
-	case PARTIAL_TAG: {
-	  /*
-	   * The upper bits of the dictionary entry match, but the lower bits don't.  Reconstruct the correct word, but update the
-	   * dictionary entry to use these new low bits.  Note that we don't perform a replacement on the dictionary entry -- we just
-	   * update this entry in-place.  One could argue that something more complex should happen with this set of the dictionary,
-	   * but for now we keep it simple.
-	   */
-	  dictionary_element_s* dict_ptr = dictionary + *(next_dict_index++);
-	  WK_word dict_entry = DICT_GET_VALUE(dict_ptr);
-	  /* Zero the low bits and then paste them into place from the compressed encoding's low-bits collection. */
-	  dict_entry &= HIGH_BITS_MASK;
-	  dict_entry |= *(next_low_bits++);
-	  /* Given this new word value, update the dictionary entry and add the word to the decompressed buffer. */
-	  *next_output = dict_entry;
-	  DICT_SET_VALUE(dict_ptr, dict_entry);
-	  DICT_MOVE_TO_FRONT(dict_ptr);
+	case PARTIAL_TAG:
+	  UNMODEL_PARTIAL(next_output);
 	  break;
-	}
-	case MISS_TAG: {
-	  /*
-	   * For an outright miss, the full value must be taken from the compressed pool of full word patterns.  Here, the dictionary
-	   * must be updated by replacing some word in the set (if it is full) with this new, wholly unmatching word.
-	   */
-	  WK_word missed_word = *(next_full_word++);
-	  DICT_UPDATE(missed_word);
-	  *next_output = missed_word;    /* and echo it to output */
+	case MISS_TAG:
+	  UNMODEL_MISS(next_output);
 	  break;
-	}
-	
-	} // switch (*next_tag)
-      
-	/* Advance to the next word in both the compressed and decompressed representations. */
-	++next_tag;
+	} // switch (tag)
+	/* Advance to the next word in the decompressed representation. */
 	next_output += WK_STRIDE;
       } // while (next_output < end_of_output)
       ++stride_offset;
@@ -1146,12 +1955,237 @@ WK_decompress (WK_word* src_buf,
       
     DEBUG_PRINT_MSG("AFTER DECOMPRESSING\n");
     DEBUG_PRINT_VAL("next_output     = ", (WK_word)next_output);
-    DEBUG_PRINT_VAL("next_tag is     = ", (WK_word)next_tag);
     DEBUG_PRINT_VAL("next_full_word  = ", (WK_word)next_full_word);
-    DEBUG_PRINT_VAL("next_dict_index = ", (WK_word)next_dict_index);
     return next_output;
   } // PHASE 2
 }
+/**
+ * Point a WK_scratch at arrays of num_words entries made on the caller's stack.
+ **/
+#if defined WK_FUSED
+#define SCRATCH_ON_STACK(scratch,num_words)				\
+  WK_word scratch##_dict_indices[SCRATCH_DICT_INDICES_SIZE(num_words)];	\
+  WK_word scratch##_low_bits    [SCRATCH_LOW_BITS_SIZE(num_words)];	\
+  WK_scratch scratch = { scratch##_dict_indices, scratch##_low_bits };
+#else
+#define SCRATCH_ON_STACK(scratch,num_words)				\
+  WK_unpacked_tags_t       scratch##_tags        [SCRATCH_TAGS_SIZE(num_words)]; \
+  WK_unpacked_dict_index_t scratch##_dict_indices[SCRATCH_DICT_INDICES_SIZE(num_words)]; \
+  WK_unpacked_low_bits_t   scratch##_low_bits    [SCRATCH_LOW_BITS_SIZE(num_words)]; \
+  WK_scratch scratch = { scratch##_tags, scratch##_dict_indices, scratch##_low_bits };
+#endif /* WK_FUSED */
+/**
+ * \brief Compress a source buffer into a destination buffer.
+ * \param src_buf The source buffer of uncompressed data.
+ * \param dst_buf The destination buffer that will contain the compressed representation.
+ * \param num_words The number of words in the source to compress.
+ * \return A pointer to the end of the destination buffer, marking the end of the compressed reprensetation generated.
+ **/
+WK_word*
+WK_compress (WK_word* src_buf,
+	     WK_word* dest_buf,
+	     unsigned int num_words) {
+  return WK_compress_budget(src_buf, dest_buf, num_words, WK_NO_BUDGET);
+}
+/**
+ * \brief WK_compress(), giving up on a page that would take more than max_bytes once compressed, e.g. one that is better stored
+ *        as it is.  The destination must hold MAX_COMPRESSED_BYTES whatever the budget (see WK_compress_scratch()).
+ * \return A pointer to the end of the compressed representation, or NULL if it would take more than max_bytes.
+ **/
+WK_word*
+WK_compress_budget (WK_word* src_buf,
+		    WK_word* dest_buf,
+		    unsigned int num_words,
+		    unsigned int max_bytes) {
+  SCRATCH_ON_STACK(scratch, num_words);
+  return WK_compress_scratch(src_buf, dest_buf, num_words, &scratch, max_bytes);
+}
+/**
+ * \brief Decompress a source buffer into a destination buffer.
+ * \param src_buf The source buffer of compressed data.
+ * \param dst_buf The destination buffer that will contain the uncompressed representation.
+ * \return A pointer to the end of the destination buffer, marking the end of the uncompressed reprensetation generated.
+ **/
+WK_word*
+WK_decompress (WK_word* src_buf,
+	       WK_word* dest_buf) {
+  /* Extract the number of uncompressed words to be processed from the compressed header. */
+  unsigned int num_words = GET_NUM_WORDS(src_buf);
+  SCRATCH_ON_STACK(scratch, num_words);
+  return WK_decompress_scratch(src_buf, dest_buf, num_words, &scratch);
+}
+/**
+ * \brief Make a context for pages of up to max_words words.  Its arrays are allocated at once, each cache line aligned.
+ * \return The context, or NULL if the memory cannot be had.
+ **/
+WK_context*
+WK_context_create (unsigned int max_words) {
+#if defined WK_FUSED
+  size_t dict_indices_bytes = WK_CACHE_LINE_ROUND(SCRATCH_DICT_INDICES_SIZE(max_words) * sizeof(WK_word));
+  size_t low_bits_bytes     = WK_CACHE_LINE_ROUND(SCRATCH_LOW_BITS_SIZE(max_words) * sizeof(WK_word));
+  size_t tags_bytes         = 0;
+#else
+  size_t tags_bytes         = WK_CACHE_LINE_ROUND(SCRATCH_TAGS_SIZE(max_words) * sizeof(WK_unpacked_tags_t));
+  size_t dict_indices_bytes = WK_CACHE_LINE_ROUND(SCRATCH_DICT_INDICES_SIZE(max_words) * sizeof(WK_unpacked_dict_index_t));
+  size_t low_bits_bytes     = WK_CACHE_LINE_ROUND(SCRATCH_LOW_BITS_SIZE(max_words) * sizeof(WK_unpacked_low_bits_t));
+#endif /* WK_FUSED */
+  WK_context* context = (WK_context*)malloc(sizeof(WK_context));
+  if (context == NULL) {
+    return NULL;
+  }
+  context->memory = malloc(tags_bytes + dict_indices_bytes + low_bits_bytes + WK_CACHE_LINE_BYTES - 1);
+  if (context->memory == NULL) {
+    free(context);
+    return NULL;
+  }
+  char* next = (char*)WK_CACHE_LINE_ROUND((uintptr_t)context->memory);
+  context->max_words = max_words;
+#if defined WK_FUSED
+  context->scratch.packed_dict_indices = (WK_word*)next;
+  context->scratch.packed_low_bits     = (WK_word*)(next + dict_indices_bytes);
+#else
+  context->scratch.tags         = (WK_unpacked_tags_t*)next;
+  context->scratch.dict_indices = (WK_unpacked_dict_index_t*)(next + tags_bytes);
+  context->scratch.low_bits     = (WK_unpacked_low_bits_t*)(next + tags_bytes + dict_indices_bytes);
+#endif /* WK_FUSED */
+  return context;
+}
+void
+WK_context_destroy (WK_context* context) {
+  free(context->memory);
+  free(context);
+}
+/**
+ * \brief WK_compress() with the context's scratch memory.
+ * \return A pointer to the end of the compressed representation, or NULL if the page has more words than the context is for.
+ **/
+WK_word*
+WK_compress_ctx (WK_context* context,
+		 WK_word* src_buf,
+		 WK_word* dest_buf,
+		 unsigned int num_words) {
+  return WK_compress_ctx_budget(context, src_buf, dest_buf, num_words, WK_NO_BUDGET);
+}
+/**
+ * \brief WK_compress_budget() with the context's scratch memory.
+ * \return A pointer to the end of the compressed representation, or NULL if it would take more than max_bytes or the page has more
+ *         words than the context is for.
+ **/
+WK_word*
+WK_compress_ctx_budget (WK_context* context,
+			WK_word* src_buf,
+			WK_word* dest_buf,
+			unsigned int num_words,
+			unsigned int max_bytes) {
+  if (num_words > context->max_words) {
+    return NULL;
+  }
+  return WK_compress_scratch(src_buf, dest_buf, num_words, &context->scratch, max_bytes);
+}
+/**
+ * \brief WK_decompress() with the context's scratch memory.
+ * \return A pointer to the end of the uncompressed representation, or NULL if the page has more words than the context is for.
+ **/
+WK_word*
+WK_decompress_ctx (WK_context* context,
+		   WK_word* src_buf,
+		   WK_word* dest_buf) {
+  unsigned int num_words = GET_NUM_WORDS(src_buf);
+  if (num_words > context->max_words) {
+    return NULL;
+  }
+  return WK_decompress_scratch(src_buf, dest_buf, num_words, &context->scratch);
+}
+/**
+ * RECORD... for WK_compressed_size(), which counts what compression would record instead of recording it.  The size of a page
+ * depends only on how many dictionary indices, low bits and full words it has, and not on their values or on its tags.
+ **/
+#undef RECORD_TAG
+#undef RECORD_DICT_INDEX_IF
+#undef RECORD_LOW_BITS_IF
+#undef RECORD_DICT_INDEX_REPEAT
+#undef RECORD_ZEROS
+#undef RECORD_MISS
+#undef CHECK_BUDGET
+#define RECORD_TAG(tag) ((void)(tag))
+#define RECORD_DICT_INDEX_IF(dict_index,condition) { \
+    (void)(dict_index);				     \
+    num_dict_indices += (condition);		     \
+  }
+#define RECORD_LOW_BITS_IF(low_bits_pattern,condition) { \
+    (void)(low_bits_pattern);				 \
+    num_low_bits += (condition);			 \
+  }
+#define RECORD_DICT_INDEX_REPEAT(dict_index,count) { \
+    (void)(dict_index);				     \
+    num_dict_indices += (count);		     \
+  }
+#define RECORD_ZEROS(count)
+#define RECORD_MISS(word_pattern) {	\
+    RECORD_TAG(MISS_TAG);		\
+    (void)(word_pattern);		\
+    ++num_full_patts;			\
+  }
+#define CHECK_BUDGET
+/**
+ * \brief The size that WK_compress() would compress a source buffer to, found by modeling it without writing anything.
+ * \param src_buf The source buffer of uncompressed data.
+ * \param num_words The number of words in the source.
+ * \return The number of bytes of the compressed representation.
+ **/
+unsigned int
+WK_compressed_size (WK_word* src_buf,
+		    unsigned int num_words) {
+  DICT_CREATE();
+  unsigned int num_dict_indices = 0;
+  unsigned int num_low_bits     = 0;
+  unsigned int num_full_patts   = 0;
+  DICT_INITIALIZE();
+  MODEL_PAGE();
+  return (FULL_PATTERNS_AREA_OFFSET(num_words) + num_full_patts +
+	  PACKED_WORDS(num_dict_indices, WK_unpacked_dict_index_t, NUM_DICT_INDEX_BITS) +
+	  PACKED_WORDS(num_low_bits, WK_unpacked_low_bits_t, NUM_LOW_BITS)) * BYTES_PER_WORD;
+}
+#if defined WK_VARIANT
+/**
+ * This variant's entry in the table of WK_variants.c, which works in bytes.
+ **/
+#define WK_VARIANT_STRING_(name) #name
+#define WK_VARIANT_STRING(name)  WK_VARIANT_STRING_(name)
+static void*
+WK_variant_context_create (unsigned int max_bytes) {
+  return WK_context_create(max_bytes / BYTES_PER_WORD);
+}
+static void
+WK_variant_context_destroy (void* context) {
+  WK_context_destroy((WK_context*)context);
+}
+static void*
+WK_variant_compress (void* context, void* src_page, void* dest_buf, unsigned int num_bytes) {
+  return WK_compress_ctx((WK_context*)context, (WK_word*)src_page, (WK_word*)dest_buf, num_bytes / BYTES_PER_WORD);
+}
+static void*
+WK_variant_decompress (void* context, void* src_buf, void* dest_page) {
+  return WK_decompress_ctx((WK_context*)context, (WK_word*)src_buf, (WK_word*)dest_page);
+}
+static unsigned int
+WK_variant_compressed_size (void* src_page, unsigned int num_bytes) {
+  return WK_compressed_size((WK_word*)src_page, num_bytes / BYTES_PER_WORD);
+}
+const WK_variant WK_VARIANT_SYMBOL(WK_variant, WK_VARIANT) = {
+  WK_VARIANT_STRING(WK_VARIANT),
+  DICTIONARY_NUM_SETS,
+  DICTIONARY_SET_SIZE,
+  NUM_LOW_BITS,
+  WK_STRIDE,
+  BITS_PER_WORD,
+  WK_variant_context_create,
+  WK_variant_context_destroy,
+  WK_variant_compress,
+  WK_variant_decompress,
+  WK_variant_compressed_size
+};
+#endif /* WK_VARIANT */
 #if defined WK_DEBUG_MAIN
 /**
  * \brief Generate artificial pages of data.  Validate and measure the compression and decompression of each.
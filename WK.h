@@ -21,6 +21,29 @@
 /* TYPES AND CONSTANTS */
 #define TRUE  1
 #define FALSE 0
+/**
+ * When compiled as one of the variants listed in WK_variants.h, take the variant's parameters, and give the functions declared
+ * below the variant's name as a suffix.
+ **/
+#if defined WK_VARIANT
+  #include "WK_variants.h"
+  #define WK_DICTIONARY_NUM_SETS WK_VARIANT_NUM_SETS(WK_VARIANT)
+  #define WK_DICTIONARY_SET_SIZE WK_VARIANT_SET_SIZE(WK_VARIANT)
+  #define WK_LOW_BITS            WK_VARIANT_LOW_BITS(WK_VARIANT)
+  #define WK_STRIDE              WK_VARIANT_STRIDE(WK_VARIANT)
+  #if WK_VARIANT_WORD_BITS(WK_VARIANT) == 32
+    #define WK_32_BIT_WORD
+  #endif
+  #define WK_compress        WK_VARIANT_SYMBOL(WK_compress, WK_VARIANT)
+  #define WK_decompress      WK_VARIANT_SYMBOL(WK_decompress, WK_VARIANT)
+  #define WK_context_create  WK_VARIANT_SYMBOL(WK_context_create, WK_VARIANT)
+  #define WK_context_destroy WK_VARIANT_SYMBOL(WK_context_destroy, WK_VARIANT)
+  #define WK_compress_ctx    WK_VARIANT_SYMBOL(WK_compress_ctx, WK_VARIANT)
+  #define WK_decompress_ctx  WK_VARIANT_SYMBOL(WK_decompress_ctx, WK_VARIANT)
+  #define WK_compress_budget     WK_VARIANT_SYMBOL(WK_compress_budget, WK_VARIANT)
+  #define WK_compress_ctx_budget WK_VARIANT_SYMBOL(WK_compress_ctx_budget, WK_VARIANT)
+  #define WK_compressed_size     WK_VARIANT_SYMBOL(WK_compressed_size, WK_VARIANT)
+#endif
 /**
  * The machine word size, and values that follow from it.  Assume 64-bit, but allow 32-bit override.
  **/
@@ -93,11 +116,11 @@
 #endif
 /**
  * A structure to store each element of the dictionary.  The structure of these element, and of the overall dictionary, depends
- * on a number of paramters.  The default, used for direct-mapped and FIFO-replaced sets, is simply an array of simple elements
- * that are solely the word-sized pattern.  The fully associative, LRU-replaced, constant-time-mapped structure uses a more
- * complex linked list node structures.
+ * on a number of paramters.  The default, used for direct-mapped and set-associative dictionaries, is simply an array of simple
+ * elements that are solely the word-sized pattern; sets keep their LRU order apart from their entries.  The fully associative,
+ * LRU-replaced structures use more complex linked list nodes, so that any entry moves to the front in constant time.
  **/
-#if DICTIONARY_ORG == DIRECT_MAPPED_ORG
+#if DICTIONARY_ORG == DIRECT_MAPPED_ORG || DICTIONARY_ORG == SET_ASSOCIATIVE_ORG
 typedef WK_word dictionary_element_s;
 #else /* All other organizations. */
 typedef struct dictionary_element_struct {
@@ -126,6 +149,19 @@ typedef struct dictionary_element_struct {
  *        the length of compressed pages against this limit as an invariant.]
  **/
 #define MAX_COMPRESSED_BYTES (BYTES_PER_PAGE * 2)
+/**
+ * A budget for the _budget forms of compression: the most bytes that the compressed page may take, beyond which compression stops
+ * and the page is left to be stored some other way.  WK_NO_BUDGET lets a page take what it takes.  The budget limits the size of
+ * the result, not how much of the destination buffer is written on the way to giving up, which may be hundreds of bytes more:
+ * the destination buffer must hold MAX_COMPRESSED_BYTES whatever the budget.
+ **/
+#define WK_NO_BUDGET (~0U)
+/**
+ * A context holds the scratch memory of compressing and decompressing pages of up to some number of words, so that calls made
+ * with it need only a few hundred bytes of stack for the dictionary, whatever the page size.  A context may be used by one
+ * thread at a time.
+ **/
+typedef struct WK_context_struct WK_context;
 /* =============================================================================================================================== */
 /* =============================================================================================================================== */
 /* C++ MANAGEMENT PROLOGUE */
@@ -147,6 +183,40 @@ WK_compress (WK_word* source_page,
 WK_word*
 WK_decompress (WK_word* source_buffer,
 	       WK_word* destination_page);
+
+WK_context*
+WK_context_create (unsigned int maximum_decompressed_words);
+
+void
+WK_context_destroy (WK_context* context);
+
+WK_word*
+WK_compress_ctx (WK_context* context,
+		 WK_word* source_page,
+		 WK_word* destination_buffer,
+		 unsigned int number_decompressed_words);
+
+WK_word*
+WK_decompress_ctx (WK_context* context,
+		   WK_word* source_buffer,
+		   WK_word* destination_page);
+
+WK_word*
+WK_compress_budget (WK_word* source_page,
+		    WK_word* destination_buffer,
+		    unsigned int number_decompressed_words,
+		    unsigned int maximum_compressed_bytes);
+
+WK_word*
+WK_compress_ctx_budget (WK_context* context,
+			WK_word* source_page,
+			WK_word* destination_buffer,
+			unsigned int number_decompressed_words,
+			unsigned int maximum_compressed_bytes);
+
+unsigned int
+WK_compressed_size (WK_word* source_page,
+		    unsigned int number_decompressed_words);
   /* =============================================================================================================================== */
 /* =============================================================================================================================== */
 /* C++ MANAGEMENT EPILOGUE */
@@ -0,0 +1,123 @@
+/* =============================================================================================================================== */
+/**
+ * \file WK_hashmap.h
+ * \brief The map that gives the fully associative dictionary constant-time lookup, from the high bits of a word to the entry
+ *        holding them.
+ *
+ * The map is a fixed-size, open-addressed table of four times as many slots as the dictionary has entries, made on the stack
+ * with the dictionary, so it needs no allocation and stays small: a slot is 32 bits, the entry's index in the low half and a
+ * fingerprint of its key in the high half, so that 4096 entries take 64 KB.  Keys are not stored; a slot whose fingerprint
+ * matches is confirmed against the high bits of the entry itself, with HASHMAP_KEY(index), which the includer defines.
+ * Collisions are resolved by linear probing, and deletion shifts the rest of the probe run back, so there are no tombstones and
+ * lookups never slow down.
+ *
+ * Entries are named by index, and a key maps to at most one of them.  WK keeps the map in step with the dictionary: a key is
+ * mapped as soon as an entry takes it and deleted when that entry is replaced, and the high bits of an entry do not otherwise
+ * change.
+ **/
+/* =============================================================================================================================== */
+/* =============================================================================================================================== */
+/* AVOID MULTIPLE INCLUSION PROLOGUE */
+#if !defined (_WK_HASHMAP_H)
+#define _WK_HASHMAP_H
+/* =============================================================================================================================== */
+/* =============================================================================================================================== */
+/* INCLUDES */
+#include <stdint.h>
+#include <string.h>
+/* =============================================================================================================================== */
+/* =============================================================================================================================== */
+/* TYPES AND CONSTANTS */
+/**
+ * The table has four times as many slots as the dictionary has entries.  Pages that miss often replace an entry per word, and
+ * at half the load the probes and shifts that replacement costs made the map slower than a linear search of 16 entries.
+ * Dictionary sizes are powers of two, so the table's is too.
+ **/
+#define HASHMAP_SLOT_BITS  (NUM_DICT_INDEX_BITS + 2)
+#define HASHMAP_SLOTS      (1 << HASHMAP_SLOT_BITS)
+#define HASHMAP_SLOT_MASK  (HASHMAP_SLOTS - 1)
+/**
+ * A slot holds an entry's index and a fingerprint of its key.  The fingerprint's top bit is always set, so that no occupied slot
+ * is empty, i.e. zero.
+ **/
+typedef uint32_t hashmap_slot_t;
+#define HASHMAP_EMPTY              0
+#define HASHMAP_INDEX_BITS         16
+#define HASHMAP_INDEX_MASK         ((1 << HASHMAP_INDEX_BITS) - 1)
+#define HASHMAP_NONE               (-1)
+#define HASHMAP_SLOT_INDEX(slot)   ((int)((slot) & HASHMAP_INDEX_MASK))
+#define HASHMAP_SLOT_FINGERPRINT(slot) ((slot) >> HASHMAP_INDEX_BITS)
+/* =============================================================================================================================== */
+/* =============================================================================================================================== */
+/* HASHING */
+/**
+ * Fibonacci hashing: the top bits of the product pick the slot, and the bits below them make the fingerprint.
+ **/
+#define HASHMAP_HASH(key)              ((uint32_t)(((uint64_t)(key) * 0x9e3779b97f4a7c15ULL) >> 32))
+#define HASHMAP_HOME(hash)             ((hash) >> (32 - HASHMAP_SLOT_BITS))
+#define HASHMAP_FINGERPRINT(hash)      (((hash) & 0x7fff) | 0x8000)
+#define HASHMAP_MAKE_SLOT(hash,index)  (((hashmap_slot_t)HASHMAP_FINGERPRINT(hash) << HASHMAP_INDEX_BITS) | (hashmap_slot_t)(index))
+/* =============================================================================================================================== */
+/* =============================================================================================================================== */
+/* MAP OPERATIONS */
+/* Declare a map, alongside the dictionary whose entries it maps to. */
+#define HASHMAP_CREATE(map) \
+  hashmap_slot_t map[HASHMAP_SLOTS];
+/* Empty the map. */
+#define HASHMAP_INIT(map) \
+  memset(map, 0, sizeof(map));
+/* Set index to the entry whose key is key, or to HASHMAP_NONE if no entry has it. */
+#define HASHMAP_LOOKUP(index,map,key) {					\
+    uint32_t hashmap_hash = HASHMAP_HASH(key);				\
+    uint32_t hashmap_fingerprint = HASHMAP_FINGERPRINT(hashmap_hash);	\
+    index = HASHMAP_NONE;						\
+    for (uint32_t hashmap_at = HASHMAP_HOME(hashmap_hash); map[hashmap_at] != HASHMAP_EMPTY; \
+	 hashmap_at = (hashmap_at + 1) & HASHMAP_SLOT_MASK) {		\
+      if (HASHMAP_SLOT_FINGERPRINT(map[hashmap_at]) == hashmap_fingerprint && \
+	  HASHMAP_KEY(HASHMAP_SLOT_INDEX(map[hashmap_at])) == (key)) {	\
+	index = HASHMAP_SLOT_INDEX(map[hashmap_at]);			\
+	break;								\
+      }									\
+    }									\
+  }
+/* Map key, which no entry has, to the entry at index. */
+#define HASHMAP_INSERT(map,key,index) {					\
+    uint32_t hashmap_hash = HASHMAP_HASH(key);				\
+    uint32_t hashmap_at   = HASHMAP_HOME(hashmap_hash);			\
+    while (map[hashmap_at] != HASHMAP_EMPTY) {				\
+      hashmap_at = (hashmap_at + 1) & HASHMAP_SLOT_MASK;		\
+    }									\
+    map[hashmap_at] = HASHMAP_MAKE_SLOT(hashmap_hash, index);		\
+  }
+/**
+ * Unmap key if it maps to the entry at index, which must still hold it.  Each slot after it in the probe run moves back into the
+ * hole unless that would take it before its home slot.
+ **/
+#define HASHMAP_DELETE(map,key,index) {					\
+    uint32_t hashmap_hash = HASHMAP_HASH(key);				\
+    hashmap_slot_t hashmap_slot = HASHMAP_MAKE_SLOT(hashmap_hash, index); \
+    uint32_t hashmap_hole = HASHMAP_HOME(hashmap_hash);			\
+    while (map[hashmap_hole] != HASHMAP_EMPTY && map[hashmap_hole] != hashmap_slot) { \
+      hashmap_hole = (hashmap_hole + 1) & HASHMAP_SLOT_MASK;		\
+    }									\
+    if (map[hashmap_hole] != HASHMAP_EMPTY) {				\
+      uint32_t hashmap_at = hashmap_hole;				\
+      for (;;) {							\
+	hashmap_at = (hashmap_at + 1) & HASHMAP_SLOT_MASK;		\
+	if (map[hashmap_at] == HASHMAP_EMPTY) {				\
+	  break;							\
+	}								\
+	uint32_t hashmap_home = HASHMAP_HOME(HASHMAP_HASH(HASHMAP_KEY(HASHMAP_SLOT_INDEX(map[hashmap_at])))); \
+	if (((hashmap_at - hashmap_home) & HASHMAP_SLOT_MASK) >= ((hashmap_at - hashmap_hole) & HASHMAP_SLOT_MASK)) { \
+	  map[hashmap_hole] = map[hashmap_at];				\
+	  hashmap_hole      = hashmap_at;				\
+	}								\
+      }									\
+      map[hashmap_hole] = HASHMAP_EMPTY;				\
+    }									\
+  }
+/* =============================================================================================================================== */
+/* =============================================================================================================================== */
+/* AVOID MULTIPLE INCLUSION EPILOGUE */
+#endif /* _WK_HASHMAP_H */
+/* =============================================================================================================================== */
@@ -0,0 +1,29 @@
+/* =============================================================================================================================== */
+/**
+ * \file WK_variants.c
+ * \brief The table of WK's compiled variants (see WK_variants.h).
+ **/
+/* =============================================================================================================================== */
+#include <string.h>
+#include "WK_variants.h"
+
+#define WK_VARIANT_ENTRY(name) &WK_VARIANT_SYMBOL(WK_variant, name),
+const WK_variant *const WK_variants[WK_NUM_VARIANTS] = { WK_VARIANTS(WK_VARIANT_ENTRY) };
+
+const WK_variant *WK_variant_named(const char *name){
+  for (unsigned int v = 0; v < WK_NUM_VARIANTS; v++)
+    if (strcmp(WK_variants[v]->name, name) == 0)
+      return WK_variants[v];
+  return NULL;
+}
+
+const WK_variant *WK_variant_find(unsigned int num_sets, unsigned int set_size, unsigned int low_bits, unsigned int stride,
+                                  unsigned int word_bits){
+  for (unsigned int v = 0; v < WK_NUM_VARIANTS; v++){
+    const WK_variant *variant = WK_variants[v];
+    if (variant->num_sets == num_sets && variant->set_size == set_size && variant->low_bits == low_bits &&
+        variant->stride == stride && variant->word_bits == word_bits)
+      return variant;
+  }
+  return NULL;
+}
@@ -0,0 +1,111 @@
+/* =============================================================================================================================== */
+/**
+ * \file WK_variants.h
+ * \brief Several parameterizations of WK in one program, chosen at runtime.
+ *
+ * WK's dictionary, low bits, stride and word width are preprocessor constants, so that every one of them folds into the code.
+ * To compare parameterizations without rebuilding, WK.c is compiled once per variant listed here, with -DWK_VARIANT=<name>:
+ * WK.h then takes the variant's parameters from its WK_VARIANT_<name> entry, and appends _<name> to the names of the functions
+ * it declares, so that the variants link side by side.  Each variant also defines a WK_variant descriptor, WK_variant_<name>,
+ * and WK_variants.c collects the descriptors into a table that can be searched by name or by parameters.
+ *
+ * The descriptors take pages and buffers as bytes, since the variants disagree on what a word is, and they work through a
+ * WK_context of their own (see WK.h).
+ *
+ * for v in wk4x4 wk16x1 wk1x16 wk8x4 wk4x4_l8 wk4x4_l12 wk4x4_l16 wk4x4_s2 wk4x4_w32; do
+ *   gcc -c -O2 -std=gnu99 -DWK_VARIANT=$v WK.c -o WK_$v.o
+ * done
+ * gcc -c -O2 -std=gnu99 WK_variants.c
+ **/
+/* =============================================================================================================================== */
+#if !defined (_WK_VARIANTS_H)
+#define _WK_VARIANTS_H
+
+/**
+ * The variants, as (number of sets, set size, low bits, stride, bits per word).  Names are short enough to name a column of
+ * Framework's results.
+ **/
+#define WK_VARIANT_wk4x4     ( 4,  4, 10, 1, 64)
+#define WK_VARIANT_wk16x1    (16,  1, 10, 1, 64)
+#define WK_VARIANT_wk1x16    ( 1, 16, 10, 1, 64)
+#define WK_VARIANT_wk8x4     ( 8,  4, 10, 1, 64)
+#define WK_VARIANT_wk4x4_l8  ( 4,  4,  8, 1, 64)
+#define WK_VARIANT_wk4x4_l12 ( 4,  4, 12, 1, 64)
+#define WK_VARIANT_wk4x4_l16 ( 4,  4, 16, 1, 64)
+#define WK_VARIANT_wk4x4_s2  ( 4,  4, 10, 2, 64)
+#define WK_VARIANT_wk4x4_w32 ( 4,  4, 10, 1, 32)
+#define WK_VARIANTS(X)							\
+  X(wk4x4) X(wk16x1) X(wk1x16) X(wk8x4) X(wk4x4_l8) X(wk4x4_l12) X(wk4x4_l16) X(wk4x4_s2) X(wk4x4_w32)
+
+/**
+ * The parameters of a variant, by name.
+ **/
+#define WK_VARIANT_PARAMETERS(name)  WK_VARIANT_PARAMETERS_(name)
+#define WK_VARIANT_PARAMETERS_(name) WK_VARIANT_##name
+#define WK_VARIANT_APPLY(macro,parameters) macro parameters
+#define WK_VARIANT_NUM_SETS_(num_sets,set_size,low_bits,stride,word_bits)  num_sets
+#define WK_VARIANT_SET_SIZE_(num_sets,set_size,low_bits,stride,word_bits)  set_size
+#define WK_VARIANT_LOW_BITS_(num_sets,set_size,low_bits,stride,word_bits)  low_bits
+#define WK_VARIANT_STRIDE_(num_sets,set_size,low_bits,stride,word_bits)    stride
+#define WK_VARIANT_WORD_BITS_(num_sets,set_size,low_bits,stride,word_bits) word_bits
+#define WK_VARIANT_NUM_SETS(name)  WK_VARIANT_APPLY(WK_VARIANT_NUM_SETS_, WK_VARIANT_PARAMETERS(name))
+#define WK_VARIANT_SET_SIZE(name)  WK_VARIANT_APPLY(WK_VARIANT_SET_SIZE_, WK_VARIANT_PARAMETERS(name))
+#define WK_VARIANT_LOW_BITS(name)  WK_VARIANT_APPLY(WK_VARIANT_LOW_BITS_, WK_VARIANT_PARAMETERS(name))
+#define WK_VARIANT_STRIDE(name)    WK_VARIANT_APPLY(WK_VARIANT_STRIDE_, WK_VARIANT_PARAMETERS(name))
+#define WK_VARIANT_WORD_BITS(name) WK_VARIANT_APPLY(WK_VARIANT_WORD_BITS_, WK_VARIANT_PARAMETERS(name))
+
+/**
+ * A function name with a variant's suffix.
+ **/
+#define WK_VARIANT_SYMBOL(function,name)  WK_VARIANT_SYMBOL_(function,name)
+#define WK_VARIANT_SYMBOL_(function,name) function##_##name
+
+#if defined (__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * A compiled variant.  compress() takes a page of num_bytes bytes and decompress() a buffer written by compress(); both return
+ * the end of what they wrote, or NULL if the page is larger than the context was created for.  compressed_size() returns the
+ * number of bytes compress() would write for a page, without writing them.
+ **/
+typedef struct {
+  const char   *name;
+  unsigned int num_sets;
+  unsigned int set_size;
+  unsigned int low_bits;
+  unsigned int stride;
+  unsigned int word_bits;
+  void *(*context_create)(unsigned int max_bytes);
+  void  (*context_destroy)(void *context);
+  void *(*compress)(void *context, void *src_page, void *dest_buf, unsigned int num_bytes);
+  void *(*decompress)(void *context, void *src_buf, void *dest_page);
+  unsigned int (*compressed_size)(void *src_page, unsigned int num_bytes);
+} WK_variant;
+
+#define WK_VARIANT_DECLARE(name) extern const WK_variant WK_VARIANT_SYMBOL(WK_variant, name);
+WK_VARIANTS(WK_VARIANT_DECLARE)
+
+/**
+ * Every variant, in the order of WK_VARIANTS, which gives each an index, WK_variant_index_<name>.
+ **/
+#define WK_VARIANT_INDEX(name) WK_VARIANT_SYMBOL(WK_variant_index, name),
+enum { WK_VARIANTS(WK_VARIANT_INDEX) WK_NUM_VARIANTS };
+extern const WK_variant *const WK_variants[WK_NUM_VARIANTS];
+
+/**
+ * \return The variant of the given name, or NULL if there is none.
+ **/
+const WK_variant *WK_variant_named(const char *name);
+
+/**
+ * \return The variant with the given parameters, or NULL if none was compiled.
+ **/
+const WK_variant *WK_variant_find(unsigned int num_sets, unsigned int set_size, unsigned int low_bits, unsigned int stride,
+                                  unsigned int word_bits);
+
+#if defined (__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* _WK_VARIANTS_H */
@@ -0,0 +1,223 @@
+/* =============================================================================================================================== */
+/**
+ * \file estimate.h
+ * \brief Predicting the compressed size of a page without compressing it.
+ *
+ * A page is reduced to a sketch of a sample of its words: how many are zero, how many repeat (exactly, or in their high bits) one
+ * of the few words before them in the page, and the histogram of their bytes.  The word counts stand in for WK's dictionary,
+ * which sees the same regularities, and the entropy of the histogram for a byte-oriented LZ codec such as LZO.  Sizes are then
+ * predicted from the counts, scaled up to the whole page, with WK's output layout (see WK.c) and the entropy bound.
+ *
+ * Only one word in ESTIMATE_SAMPLE_STRIDE is classified, and the bytes of one in ESTIMATE_BYTE_STRIDE counted, so that a sketch
+ * costs a small fraction of compressing the page.  A sampled word is compared with its predecessors all at once with AVX2 when
+ * the CPU has it.  The histogram is small enough that its entropy comes from a table of c*log2(c), filled in by estimate_init().
+ *
+ * The predictions are deliberately cheap rather than exact.  Framework -e measures how far they are from the real sizes.
+ **/
+/* =============================================================================================================================== */
+#if !defined (_ESTIMATE_H)
+#define _ESTIMATE_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "WK.h"
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(WK_32_BIT_WORD)
+#include <immintrin.h>
+#define ESTIMATE_HAVE_AVX2 1
+#endif
+
+/**
+ * Every ESTIMATE_SAMPLE_STRIDE'th word is sampled, and compared with the ESTIMATE_RECENT words before it, a stand-in for one set
+ * of WK's dictionary.  The bytes of every ESTIMATE_BYTE_STRIDE'th word, a multiple of the sample stride, go into the histogram:
+ * counting them is most of the cost of a sketch, and sampling them more often did not make predictions any better.
+ **/
+#define ESTIMATE_RECENT        4
+#define ESTIMATE_SAMPLE_STRIDE 8
+#define ESTIMATE_BYTE_STRIDE   16
+#define ESTIMATE_MAX_BYTES     ((WORDS_PER_PAGE + ESTIMATE_BYTE_STRIDE - 1)/ESTIMATE_BYTE_STRIDE*BYTES_PER_WORD)
+#define ESTIMATE_HISTOGRAMS    4
+/**
+ * WK's fixed costs, in bits: a tag per word, a dictionary index per match, the low bits of a partial match.  Misses are stored
+ * whole.  Header, index and low-bits areas each take whole words.
+ **/
+#define ESTIMATE_WK_HEADER_WORDS 4
+#define ESTIMATE_WK_TAG_BITS     2
+#define ESTIMATE_WK_INDEX_BITS   4
+/**
+ * LZO has no entropy coder, so it spends more than the entropy of the sample on the bytes it does not find matches for: the factor
+ * was fitted on our traces.  It also spends a few bytes per run of zero words and per page.
+ **/
+#define ESTIMATE_LZ_LITERAL_COST 1.15
+#define ESTIMATE_LZ_ZERO_RUN     2
+#define ESTIMATE_LZ_OVERHEAD     8
+
+/* The kinds of prediction made for a page */
+#define ESTIMATE_NONE -1
+#define ESTIMATE_WK    0   /* WK */
+#define ESTIMATE_LZ    1   /* a byte-oriented LZ codec */
+#define ESTIMATE_BEST  2   /* the smaller of the two, or the page stored raw if neither shrinks it */
+#define ESTIMATE_KINDS 3
+
+typedef struct {
+  uint32_t words;        /* in the page */
+  uint32_t samples;      /* words sampled, which the counts below are of */
+  uint32_t zeros;
+  uint32_t zero_runs;    /* zero words following a nonzero one */
+  uint32_t exact;        /* nonzero words equal to one of the ESTIMATE_RECENT before them */
+  uint32_t partial;      /* nonzero words sharing only their high bits with one */
+  uint32_t bytes;        /* bytes in the histogram, from the nonzero words */
+  uint32_t distinct;     /* byte values seen, listed in seen[] */
+  uint32_t counts[256];
+  uint8_t  seen[256];
+} page_sketch;
+
+typedef struct {
+  uint32_t size[ESTIMATE_KINDS];   /* predicted bytes, by ESTIMATE_... */
+} page_estimate;
+
+/**
+ * c*log2(c) for every count the histogram of one page can reach.
+ **/
+static double estimate_clog2c[ESTIMATE_MAX_BYTES + 1];
+
+/**
+ * Fill in the entropy table.  Must be called once before the first estimate, before any threads are started.
+ **/
+static inline void estimate_init(){
+  estimate_clog2c[0] = 0;
+  for (int c = 1; c <= ESTIMATE_MAX_BYTES; c++)
+    estimate_clog2c[c] = c*log2((double)c);
+}
+
+/**
+ * Whether word i of a page, which is not zero, equals (*exact) or shares its high bits with (*partial) one of the ESTIMATE_RECENT
+ * words before it.
+ **/
+static inline void estimate_match(const WK_word *page, unsigned int i, int *exact, int *partial){
+  WK_word word = page[i];
+  *exact = *partial = 0;
+  for (unsigned int r = 1; r <= ESTIMATE_RECENT && r <= i; r++){
+    *exact |= page[i - r] == word;
+    *partial |= (page[i - r] >> NUM_LOW_BITS) == (word >> NUM_LOW_BITS);
+  }
+}
+
+#ifdef ESTIMATE_HAVE_AVX2
+/**
+ * estimate_match() for a word with ESTIMATE_RECENT words before it, compared with all of them at once.
+ **/
+__attribute__((target("avx2")))
+static inline void estimate_match_avx2(const WK_word *page, unsigned int i, int *exact, int *partial){
+  __m256i word = _mm256_set1_epi64x((long long)page[i]);
+  __m256i before = _mm256_loadu_si256((const __m256i *)(page + i - ESTIMATE_RECENT));
+  *exact = _mm256_movemask_epi8(_mm256_cmpeq_epi64(word, before)) != 0;
+  *partial = _mm256_movemask_epi8(_mm256_cmpeq_epi64(_mm256_srli_epi64(word, NUM_LOW_BITS),
+                                                     _mm256_srli_epi64(before, NUM_LOW_BITS))) != 0;
+}
+#endif
+
+/**
+ * Sketch a page of numWords words from every ESTIMATE_SAMPLE_STRIDE'th word.
+ **/
+static inline void estimate_sketch(const WK_word *page, unsigned int numWords, page_sketch *sketch){
+  sketch->words = numWords;
+  sketch->samples = sketch->zeros = sketch->zero_runs = sketch->exact = sketch->partial = 0;
+  sketch->bytes = sketch->distinct = 0;
+  // bytes are counted in ESTIMATE_HISTOGRAMS histograms by their place in the word, so that increments of the same count, which
+  // pointer-heavy pages make a lot of, do not wait on each other
+  uint16_t histograms[ESTIMATE_HISTOGRAMS][256];
+  memset(histograms, 0, sizeof(histograms));
+#ifdef ESTIMATE_HAVE_AVX2
+  int avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+  for (unsigned int i = 0; i < numWords; i += ESTIMATE_SAMPLE_STRIDE){
+    WK_word word = page[i];
+    sketch->samples++;
+    if (word == 0){
+      sketch->zeros++;
+      sketch->zero_runs += i == 0 || page[i - 1] != 0;
+      continue;
+    }
+
+    int exact, partial;
+#ifdef ESTIMATE_HAVE_AVX2
+    if (avx2 && i >= ESTIMATE_RECENT)
+      estimate_match_avx2(page, i, &exact, &partial);
+    else
+#endif
+      estimate_match(page, i, &exact, &partial);
+    sketch->exact += exact;
+    sketch->partial += partial & !exact;
+
+    // only words on the byte stride reach the histogram, and zero words never do
+    if (i % ESTIMATE_BYTE_STRIDE != 0)
+      continue;
+    for (unsigned int b = 0; b < BYTES_PER_WORD; b++)
+      histograms[b % ESTIMATE_HISTOGRAMS][(uint8_t)(word >> (BITS_PER_BYTE*b))]++;
+    sketch->bytes += BYTES_PER_WORD;
+  }
+
+  for (unsigned int byte = 0; byte < 256; byte++){
+    uint32_t count = 0;
+    for (unsigned int h = 0; h < ESTIMATE_HISTOGRAMS; h++)
+      count += histograms[h][byte];
+    sketch->counts[byte] = count;
+  }
+  for (unsigned int byte = 0; byte < 256; byte++){
+    sketch->seen[sketch->distinct] = (uint8_t)byte;
+    sketch->distinct += sketch->counts[byte] != 0;
+  }
+}
+
+/**
+ * The order-0 entropy of the sampled bytes, in bits per byte.
+ **/
+static inline double estimate_entropy(const page_sketch *sketch){
+  if (sketch->bytes == 0)
+    return 0;
+  double sum = 0;
+  for (unsigned int d = 0; d < sketch->distinct; d++)
+    sum += estimate_clog2c[sketch->counts[sketch->seen[d]]];
+  return log2((double)sketch->bytes) - sum/sketch->bytes;
+}
+
+/**
+ * Predict compressed sizes from a sketch, its counts scaled from the sample to the whole page.  WK's is its layout filled in with
+ * the word counts.  The LZ codec is taken to store zero runs and words repeating a recent one almost for free, and the remaining
+ * words at the entropy of the sample.
+ **/
+static inline void estimate_predict(const page_sketch *sketch, page_estimate *estimate){
+  const unsigned int low_per_word = BITS_PER_WORD/NUM_LOW_BITS;
+  double scale = sketch->samples == 0 ? 0 : (double)sketch->words/sketch->samples;
+  double matches = (sketch->exact + sketch->partial)*scale;
+  double misses = (sketch->samples - sketch->zeros - sketch->exact - sketch->partial)*scale;
+  unsigned int wk_words = ESTIMATE_WK_HEADER_WORDS
+                        + (sketch->words*ESTIMATE_WK_TAG_BITS + BITS_PER_WORD - 1)/BITS_PER_WORD
+                        + (unsigned int)(misses + 0.5)
+                        + (unsigned int)ceil(matches*ESTIMATE_WK_INDEX_BITS/BITS_PER_WORD)
+                        + (unsigned int)ceil(sketch->partial*scale/low_per_word);
+  estimate->size[ESTIMATE_WK] = wk_words*BYTES_PER_WORD;
+
+  double literal_bytes = (sketch->samples - sketch->zeros - sketch->exact)*scale*BYTES_PER_WORD;
+  estimate->size[ESTIMATE_LZ] = (uint32_t)(literal_bytes*ESTIMATE_LZ_LITERAL_COST*estimate_entropy(sketch)/BITS_PER_BYTE
+                                           + sketch->zero_runs*scale*ESTIMATE_LZ_ZERO_RUN + 0.5) + ESTIMATE_LZ_OVERHEAD;
+
+  uint32_t best = sketch->words*BYTES_PER_WORD;
+  for (int kind = ESTIMATE_WK; kind <= ESTIMATE_LZ; kind++)
+    if (estimate->size[kind] < best)
+      best = estimate->size[kind];
+  estimate->size[ESTIMATE_BEST] = best;
+}
+
+/**
+ * Predict the compressed sizes of a page of numWords words.
+ **/
+static inline void estimate_page(const WK_word *page, unsigned int numWords, page_estimate *estimate){
+  page_sketch sketch;
+  estimate_sketch(page, numWords, &sketch);
+  estimate_predict(&sketch, estimate);
+}
+
+#endif /* _ESTIMATE_H */
@@ -1,51 +1,199 @@
 extern "C" {
 	#include "WK.h"
-#ifndef MINI
+	#include "WK_variants.h"
 	#include "lzo_conf.h"
 	#include "lzoconf.h"
 	#include "lzo1.h"
-#endif
-#ifdef MINI
-	#include "minilzo.h"
-#endif
+	#include "lzo1x.h"
 }
 
-typedef struct{
-  WK_word       address;
-  unsigned int  comp_size;
-  long long     comp_time;
-  long long     decomp_time;
-} page_info;
+#include "results.h"
 
+// compress() and decompress() return NULL on failure, leaving the library's
+// status code in error. They do no I/O, since every call is timed.
+//
+// compressedSize() returns the number of bytes compress() would write, or 0
+// on failure. dst is scratch that codecs able to size a page without
+// compressing it leave alone.
+//
+// The batch versions handle count pages per call: page i is read from src[i]
+// and written to dst[i], and ends[i] receives the end of its output. They
+// return the number of pages done before the first failure.
 class CompressionAlgo{
+public:
+	int error;
+
+	CompressionAlgo(): error(0) {}
+	virtual ~CompressionAlgo() {}
 	virtual WK_word * compress(WK_word *src, WK_word *dst, unsigned int numWords) = 0;
 	virtual WK_word * decompress(WK_word *src, WK_word *dst, unsigned int size) = 0;
+	virtual int compressBatch(WK_word **src, WK_word **dst, WK_word **ends, unsigned int numWords, int count) = 0;
+	virtual int decompressBatch(WK_word **src, WK_word **dst, unsigned int *sizes, WK_word **ends, int count) = 0;
+	virtual unsigned int compressedSize(WK_word *src, WK_word *dst, unsigned int numWords) = 0;
 };
 
-class PassthroughAlgo: public CompressionAlgo{
+// Pull a page into cache ahead of its use, so that the codec working on the
+// page before it hides the latency. Hardware prefetchers stop at page
+// boundaries, which is exactly where a batch moves on to an unrelated page.
+static inline void prefetchPage(const void *page, unsigned int bytes){
+	for (unsigned int line = 0; line < bytes; line += 64)
+		__builtin_prefetch((const char *)page + line);
+}
+
+// Every codec derives from CodecBase<itself>, which supplies the batch calls,
+// and a compressedSize() that compresses the page, for codecs with no cheaper way.
+// They call the codec's compress()/decompress() without virtual dispatch, so
+// the compiler can inline them into the loop. Framework's drivers do the same
+// (see timeEachPage()), so a virtual call is made once per run of pages
+// rather than once per page.
+template <class Codec>
+class CodecBase: public CompressionAlgo{
+public:
+	int compressBatch(WK_word **src, WK_word **dst, WK_word **ends, unsigned int numWords, int count){
+		Codec *codec = static_cast<Codec *>(this);
+		for (int i = 0; i < count; i++){
+			if (i + 1 < count)
+				prefetchPage(src[i + 1], numWords*sizeof(WK_word));
+			if ((ends[i] = codec->Codec::compress(src[i], dst[i], numWords)) == NULL)
+				return i;
+		}
+		return count;
+	}
+
+	int decompressBatch(WK_word **src, WK_word **dst, unsigned int *sizes, WK_word **ends, int count){
+		Codec *codec = static_cast<Codec *>(this);
+		for (int i = 0; i < count; i++){
+			if (i + 1 < count)
+				prefetchPage(src[i + 1], sizes[i + 1]);
+			if ((ends[i] = codec->Codec::decompress(src[i], dst[i], sizes[i])) == NULL)
+				return i;
+		}
+		return count;
+	}
+
+	unsigned int compressedSize(WK_word *src, WK_word *dst, unsigned int numWords){
+		WK_word *end = static_cast<Codec *>(this)->Codec::compress(src, dst, numWords);
+		return end == NULL ? 0 : (char *)end - (char *)dst;
+	}
+};
+
+class PassthroughAlgo: public CodecBase<PassthroughAlgo>{
 public: 
 	WK_word * compress(WK_word *src, WK_word *dst, unsigned int numWords);
 	WK_word * decompress(WK_word *src, WK_word *dst, unsigned int size);
 };
 
-class WKAlgo: public CompressionAlgo{
+// WK's scratch memory is a context, so that a worker's stack only holds the dictionary
+class WKAlgo: public CodecBase<WKAlgo>{
+	WK_context *context;
+public:
+	WKAlgo();
+	~WKAlgo();
+	WK_word * compress(WK_word *src, WK_word *dst, unsigned int numWords);
+	WK_word * decompress(WK_word *src, WK_word *dst, unsigned int size);
+	// compress(), giving up (and returning NULL) as soon as the output is
+	// sure to take more than maxBytes. dst may be written past maxBytes
+	// before it does (see WK.h).
+	WK_word * compressWithin(WK_word *src, WK_word *dst, unsigned int numWords, unsigned int maxBytes);
+	unsigned int compressedSize(WK_word *src, WK_word *dst, unsigned int numWords);
+};
+
+// One of the WK variants compiled in (see WK_variants.h), by its index
+template <int V>
+class WKVariantAlgo: public CodecBase<WKVariantAlgo<V> >{
+	void *context;
 public:
+	WKVariantAlgo(){
+		context = WK_variants[V]->context_create(WORDS_PER_PAGE*sizeof(WK_word));
+		if (context == NULL){
+			printf("internal error - unable to allocate %s's context\n", WK_variants[V]->name);
+			exit(1);
+		}
+	}
+	~WKVariantAlgo(){
+		WK_variants[V]->context_destroy(context);
+	}
+	WK_word * compress(WK_word *src, WK_word *dst, unsigned int numWords){
+		return (WK_word *)WK_variants[V]->compress(context, src, dst, numWords*sizeof(WK_word));
+	}
+	WK_word * decompress(WK_word *src, WK_word *dst, unsigned int size){
+		return (WK_word *)WK_variants[V]->decompress(context, src, dst);
+	}
+	unsigned int compressedSize(WK_word *src, WK_word *dst, unsigned int numWords){
+		return WK_variants[V]->compressed_size(src, numWords*sizeof(WK_word));
+	}
+};
+
+// The LZO codecs own their work memory for as long as they live
+class minilzoAlgo: public CodecBase<minilzoAlgo>{
+	lzo_voidp wrkmem;
+public:
+	minilzoAlgo();
+	~minilzoAlgo();
 	WK_word * compress(WK_word *src, WK_word *dst, unsigned int numWords);
 	WK_word * decompress(WK_word *src, WK_word *dst, unsigned int size);
 };
 
-#ifdef MINI
-class minilzoAlgo: public CompressionAlgo{
+class lzo1Algo: public CodecBase<lzo1Algo>{
+	lzo_voidp wrkmem;
 public:
+	lzo1Algo();
+	~lzo1Algo();
 	WK_word * compress(WK_word *src, WK_word *dst, unsigned int numWords);
 	WK_word * decompress(WK_word *src, WK_word *dst, unsigned int size);
 };
-#endif
 
-#ifndef MINI
-class lzo1Algo: public CompressionAlgo{
+// Cache state a codec is timed in: as the data happens to be (right after the
+// page was read, output still in L1), with the page and every buffer flushed
+// from cache before each call, or with output buffers rotating through a ring
+// much larger than the cache.
+#define CACHE_WARM 0
+#define CACHE_COLD 1
+#define CACHE_RING 2
+
+// Picks a codec for each page from a sample of its words and stores the choice
+// in a tag at the front of the output (see Framework.cpp)
+#define ADAPTIVE_ZERO    0
+#define ADAPTIVE_RAW     1
+#define ADAPTIVE_WK      2
+#define ADAPTIVE_LZO1    3    // reserved: choose() does not pick lzo1
+#define ADAPTIVE_MINILZO 4
+
+class AdaptiveAlgo: public CodecBase<AdaptiveAlgo>{
+	WKAlgo      wk;
+	minilzoAlgo minilzo;
 public:
+	int choose(WK_word *src, unsigned int numWords);
 	WK_word * compress(WK_word *src, WK_word *dst, unsigned int numWords);
 	WK_word * decompress(WK_word *src, WK_word *dst, unsigned int size);
 };
-#endif
+
+// A run of pages for one codec to compress and decompress. Results add up
+// into results[k][column], so several pages may share the result of a unit.
+typedef struct{
+  WK_word      **srcs;
+  int          count;
+  WK_word      *dest_area;     // count slots of 2 pages
+  WK_word      *udest_area;    // count pages
+  codec_result **results;
+  int          column;
+  int          cache;          // CACHE_...
+} page_run;
+
+// A codec Framework can run, under the name used by -c and in the results file.
+// Each worker thread creates its own instance, so codecs may keep state. The
+// drivers are the timing loops specialized for the codec, and the loop that
+// only sizes pages, for -z (see Framework.cpp).
+typedef struct{
+  const char      *name;
+  CompressionAlgo *(*create)();
+  void            (*timeEachPage)(CompressionAlgo *algo, const char *name, page_run *run);
+  void            (*timeWholeRun)(CompressionAlgo *algo, const char *name, page_run *run);
+  void            (*sizeEachPage)(CompressionAlgo *algo, const char *name, page_run *run);
+  int             estimate;     // ESTIMATE_... prediction its sizes are checked against by -e
+} codec_entry;
+
+template <class Algo>
+CompressionAlgo *createCodec(){
+	return new Algo;
+}
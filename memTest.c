@@ -1,9 +1,36 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+/*
+ * Without arguments, makes one small allocation. Given a count and a size, it
+ * makes count allocations of size bytes, fills them and checks them back; from
+ * 128 KB up malloc maps each one on its own, next to the libraries, which is
+ * what a TRACK_SIZE larger than a page must cope with:
+ * QUEUE_SIZE=2 TRACK_SIZE=2M LD_PRELOAD=./memoryFunctions.so ./memTest 64 200000
+ */
 int main (int argc, char **argv){
-	printf("Pre-malloc\n");
-	char *a = (char*) malloc(4);
-	printf("Post-malloc\n");
-	free(a);
-}
\ No newline at end of file
+	if (argc < 3){
+		printf("Pre-malloc\n");
+		char *a = (char*) malloc(4);
+		printf("Post-malloc\n");
+		free(a);
+		return 0;
+	}
+
+	int count = atoi(argv[1]);
+	size_t size = strtoul(argv[2], NULL, 10);
+	char **blocks = (char**) malloc(count * sizeof(char*));
+	int i, bad = 0;
+	for (i = 0; i < count; i++){
+		blocks[i] = (char*) malloc(size);
+		memset(blocks[i], i, size);
+	}
+	for (i = 0; i < count; i++){
+		if (blocks[i][0] != (char)i || blocks[i][size - 1] != (char)i) bad++;
+		free(blocks[i]);
+	}
+	free(blocks);
+	printf("%d blocks of %zu bytes, %d bad\n", count, size, bad);
+	return bad != 0;
+}
@@ -10,23 +10,48 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
-
-#define PAGE_SIZE 4096
-#define OFFSET_MASK 0xfff
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+#define DEFAULT_TRACK_SIZE 4096
+#define OFFSET_MASK (trackSize - 1)
 #define PAGEBASE_MASK ~OFFSET_MASK
-#define PAGENUM(addr) (addr & PAGEBASE_MASK) >> 12
+#define PAGENUM(addr) ((addr & PAGEBASE_MASK) >> trackShift)
 #define INBOUND_MASK 0x8000000000000000
+#define QUEUE_REGION_SIZE (sizeof(page_num_type)*1000000)
+#define USER_ADDRESS_BITS 47
+#define DUMP_DIR "/home/class17/mmacoy17/ThesisTestCode/interposition-library"
 
 /*
  * To use:
- * gcc -shared -fPIC memoryFunctions.c -o memoryFunctions.so -ldl
+ * gcc -shared -fPIC memoryFunctions.c -o memoryFunctions.so -ldl -lpthread
  * bash
  * export LD_PRELOAD = ./memoryFunctions.so
  * export QUEUE_SIZE = ""
+ * export TRACK_SIZE = "2M"      (optional, defaults to 4K)
+ * ./memTest 64 200000            (large allocations next to libc, see memTest.c)
  */
 
 typedef uint64_t page_num_type;
 
+// Tracking granularity. Every queue entry, protection change and dump covers one
+// aligned unit of trackSize bytes. Set from TRACK_SIZE so that THP-backed heaps can
+// be tracked (and protected) a whole huge page at a time without splitting it.
+// Such units are only tracked while all of them is the allocator's (see unitOwned).
+size_t trackSize = DEFAULT_TRACK_SIZE;
+int trackShift = 12;
+size_t basePageSize = DEFAULT_TRACK_SIZE;
+
+// One bit per unit that movePage has protected, reserved for the whole user
+// address space and only backed where units are. Only kept when units are
+// larger than a base page, when a fault can land in a unit that is not ours.
+uint64_t *protectedUnits = NULL;
+page_num_type protectedUnitsCount = 0;
+
 // Used to determine if this is actually running a benchmark
 int VALID;
  
@@ -40,9 +65,15 @@ page_num_type *queueCOLDf;
 page_num_type *queueCOLDb;
 
 
-//File for page dumps
+//File for page dumps. Each process appends to its own shard, named dumpBase.<pid>
 int file;
 int add_file;
+char dumpBase[256];
+
+// Time and thread of the last record written to file, which the next record's
+// stamp is encoded against. dumpLock keeps stamps and writes in the same order.
+trace_clock dumpClock;
+volatile char dumpLock = 0;
 
 //tracker for empties
 int empties = 0;
@@ -54,6 +85,10 @@ static int prot_in = 0;
 
 
 int dumbSearchAlgo(void *);
+int unitOwned(uintptr_t, int);
+void markProtected(uintptr_t);
+int unitProtected(uintptr_t);
+void restoreUnit(uintptr_t);
 void movePage(void *, int);
 
 //============================= MEMORY MANAGEMENT =============================
@@ -80,17 +115,17 @@ void *malloc(size_t size){
 
   // if the memory is allocated over multiple pages
 
-  while((location_copy / 4096) <= (end/4096)){
+  while((location_copy >> trackShift) <= (end >> trackShift)){
     int check = dumbSearchAlgo((void *)location_copy);
     if (check >= 0){
       // Page was either in the HOT queue already, or just put there by mprotect()
       //return location;
     }
-    else{
+    else if (unitOwned(location_copy, (PROT_READ | PROT_WRITE))){
       // New page. Must add to HOT queue
       movePage((void *)location_copy, 1);
     }
-    location_copy += 4096;
+    location_copy += trackSize;
     }
 
   return location;
@@ -118,17 +153,17 @@ void *calloc(size_t nmeb, size_t size){
 
   // if the memory is allocated over multiple pages
 
-  while((location_copy / 4096) <= (end/4096)){
+  while((location_copy >> trackShift) <= (end >> trackShift)){
     int check = dumbSearchAlgo((void *)location_copy);
     if (check >= 0){
       // Page was either in the HOT queue already, or just put there by mprotect()
       //return location;
     }
-    else{
+    else if (unitOwned(location_copy, (PROT_READ | PROT_WRITE))){
       // New page. Must add to HOT queue
       movePage((void *)location_copy, 1);
     }
-    location_copy += 4096;
+    location_copy += trackSize;
     }
 
   return location;
@@ -154,17 +189,17 @@ void *realloc(void *ptr, size_t size){
 
   // if the memory is allocated over multiple pages
 
-  while ((location_copy / 4096) <= (end/4096)){
+  while ((location_copy >> trackShift) <= (end >> trackShift)){
     int check = dumbSearchAlgo((void *)location_copy);
     if (check >= 0){
       // Page was either in the HOT queue already, or just put there by mprotect()
       //return location;
     }
-    else{
+    else if (unitOwned(location_copy, (PROT_READ | PROT_WRITE))){
       // New page. Must add to HOT queue
       movePage((void *)location_copy, 1);
     }
-    location_copy += 4096;
+    location_copy += trackSize;
     }
 
   return location;
@@ -186,10 +221,58 @@ void free(void *ptr){
 //============================== PAGE HANDLING ================================
 
 
+/*
+ * Starts a dump file, which must not exist yet: a shard of the same name may
+ * be this very process's before it exec'd, and is never overwritten. Every
+ * file begins with a trace header so Framework knows how many bytes
+ * follow each page number, and TraceMerge knows which process wrote it and when.
+ * The header also restarts the clock that record stamps are delta encoded
+ * against, so a file is only ever written by the process that opened it.
+ */
+int openDump(const char *name){
+	int fd = open(name, (O_WRONLY | O_CREAT | O_EXCL), (S_IRUSR | S_IWUSR));
+	if (fd >= 0){
+	  struct timespec now;
+	  clock_gettime(CLOCK_MONOTONIC, &now);
+
+	  trace_header header;
+	  trace_init_header(&header, TRACE_MAGIC, trackSize);
+	  header.flags = TRACE_FLAG_TIMESTAMPS;
+	  header.pid = getpid();
+	  header.ppid = getppid();
+	  header.start_ns = (uint64_t)now.tv_sec*1000000000 + now.tv_nsec;
+	  write(fd, &header, sizeof(header));
+	  trace_clock_init(&dumpClock, &header);
+	}
+	return fd;
+}
+
+/*
+ * Opens this process's own shard of the dump, named dumpBase.<pid>. If that
+ * name is taken, by an earlier run or by the program this process exec'd from,
+ * or if writing to the shard fails, the process moves on to dumpBase.<pid>.1,
+ * .2 and so on, each a shard of its own.
+ */
+int dumpRetries = 0;
+
+int openShard(){
+	char shardName[sizeof(dumpBase) + 32];
+	for (;;){
+	  if (dumpRetries == 0)
+	    snprintf(shardName, sizeof(shardName), "%s.%d", dumpBase, (int)getpid());
+	  else
+	    snprintf(shardName, sizeof(shardName), "%s.%d.%d", dumpBase, (int)getpid(), dumpRetries);
+	  int fd = openDump(shardName);
+	  if (fd >= 0 || errno != EEXIST) return fd;
+	  dumpRetries++;
+	}
+}
+
 /*
  * Takes the contents of a page being moved in or out of the hot
  * queue and dumps it, preceeded by the page number and direction
  * of movement within the queues, out to a set file. (Use env var later for file?)
+ * A "page" here is one tracking unit of trackSize bytes.
  *
  * direction of 0 indicates moving out of the HOT queue, 1 indicates moving in
  * parameter addr is the address and not page number
@@ -200,31 +283,43 @@ void dumpPage(void *addr, int direction){
 	if (pageNumber == 0){
 		return;	// Do not dump if it is an empty page
 	}
+	void *pageAddr = (void *)(pageNumber << trackShift);
+	if (!unitOwned((uintptr_t)pageAddr, (PROT_READ | PROT_WRITE))){
+		return;	// Nor if part of it is not the allocator's to read
+	}
 	if (direction == 1) pageNumber = (pageNumber | INBOUND_MASK);
 
-	// write the page number, and direction of queue movement
-	void *pageAddr = (void *)((page_num_type)pageNumber << 12);
-	void *pageNumPtr = &pageNumber;
-	void *pageAddrPtr = &pageAddr;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	uint64_t timeStamp = (uint64_t)now.tv_sec*1000000000 + now.tv_nsec;
+	uint32_t tid = (uint32_t)syscall(SYS_gettid);
+	uint8_t stamp[2*TRACE_MAX_VARINT];
 
-	//if (direction == 1) printf("%d  %p\n", prot_in, (void *)pageNumber);
-	int err = write(file, pageNumPtr, sizeof(pageNumPtr));
-	//write(add_file, pageNumPtr, sizeof(pageNumPtr));
-	if (err != 8){
-	  printf("\n number error was number: %d **********\n", errno);
-	  file = open("/home/class17/mmacoy17/ThesisTestCode/interposition-library/SPEC_Dump.txt", (O_RDWR | O_CREAT | O_APPEND), (S_IRUSR | S_IWUSR));
-	  err = write(file, pageNumPtr, sizeof(pageNumPtr));
-	  printf("\n********* response to error in # was writing %d bytes %d **********\n", err, errno);
-	}
+	// write the page number, and direction of queue movement, when and by which
+	// thread it moved, then the contents of the page.
+	struct iovec record[3];
+	record[0].iov_base = &pageNumber;
+	record[0].iov_len = sizeof(pageNumber);
+	record[1].iov_base = stamp;
+	record[2].iov_base = pageAddr;
+	record[2].iov_len = trackSize;
+
+	while (__atomic_test_and_set(&dumpLock, __ATOMIC_ACQUIRE));
+	record[1].iov_len = trace_encode_stamp(&dumpClock, timeStamp, tid, stamp);
 
-	// write the contents of the page
-	err = write(file, pageAddrPtr, (size_t)PAGE_SIZE);
-	if (err != 4096){
-	  printf("\n page error was number: %d **********\n", errno);
-	  file = open("/home/class17/mmacoy17/ThesisTestCode/interposition-library/SPEC_Dump.txt", (O_RDWR | O_CREAT | O_APPEND), (S_IRUSR | S_IWUSR));
-	  err = write(file, pageAddrPtr, (size_t)PAGE_SIZE);
-	  printf("\n********* response to error in page was writing %d bytes %d **********\n", err, errno);
+	//if (direction == 1) printf("%d  %p\n", prot_in, (void *)pageNumber);
+	ssize_t err = writev(file, record, 3);
+	//write(add_file, &pageNumber, sizeof(pageNumber));
+	if (err != (ssize_t)(sizeof(pageNumber) + record[1].iov_len + trackSize)){
+	  printf("\n record error was number: %d **********\n", errno);
+	  close(file);
+	  dumpRetries++;
+	  file = openShard();
+	  record[1].iov_len = trace_encode_stamp(&dumpClock, timeStamp, tid, stamp);
+	  err = writev(file, record, 3);
+	  printf("\n********* response to error in record was writing %zd bytes %d **********\n", err, errno);
 	}
+	__atomic_clear(&dumpLock, __ATOMIC_RELEASE);
 
 }
 
@@ -278,19 +373,19 @@ int locateAndRemove(int number){
  * parameter addr is the address of the page not the page number
  */
 void movePage(void *addr, int direction){
-  //printf("%s %p, %d\n", "movePage() called with the parameters: ", (void *)((((uintptr_t)addr)>>12)<<12), direction);
+  //printf("%s %p, %d\n", "movePage() called with the parameters: ", (void *)((((uintptr_t)addr)>>trackShift)<<trackShift), direction);
 
 	if (direction == 1){
 		// start by clearing out the spot
 		movePage(NULL, 0);
 
 		// check where in the COLD queue the page was (if anywhere) and remove it
-		page_num_type location = locateAndRemove((page_num_type)((uintptr_t)addr >> 12));
+		page_num_type location = locateAndRemove((page_num_type)((uintptr_t)addr >> trackShift));
 		//if (location != -1)
 		//	addMemRef(location);
 
 		// overwrite the front of the queue and increment
-		*queueHOTf = (page_num_type)((uintptr_t)addr >> 12);
+		*queueHOTf = (page_num_type)((uintptr_t)addr >> trackShift);
 
 
 		// TODO is this overwriting in the statics area?
@@ -300,10 +395,14 @@ void movePage(void *addr, int direction){
 		if(*queueHOTf != 0){
 			bumpBackCold();
 			*queueCOLDf = *queueHOTf;
-			uintptr_t addressOfPage = ((uintptr_t)*queueHOTf) << 12;
+			uintptr_t addressOfPage = ((uintptr_t)*queueHOTf) << trackShift;
 
-			//protect this page to induce a SIGSEGV signal when referenced
-			mprotect((void *)addressOfPage, PAGE_SIZE, PROT_NONE);
+			//protect the whole aligned unit to induce a SIGSEGV signal when referenced,
+			//unless it is no longer the allocator's alone, in which case it drops out
+			if (unitOwned(addressOfPage, (PROT_READ | PROT_WRITE))){
+			  markProtected(addressOfPage);
+			  mprotect((void *)addressOfPage, trackSize, PROT_NONE);
+			}
 		}
 		else{
 		  empties++;
@@ -321,6 +420,9 @@ int mprotect(void *addr, size_t len, int prot){
   if (prot == (PROT_READ | PROT_WRITE)) direction = 1;
   //printf("protecting: %p  %lu %d\n", addr, len, direction);
 
+  // pages leaving the HOT queue are dumped while they can still be read
+  if (VALID && direction == 0) dumpPage(addr, direction);
+
   orig_mprotect original_mprotect;
   original_mprotect = (orig_mprotect)dlsym(RTLD_NEXT, "mprotect");
   int ret_value = original_mprotect(addr, len, prot);
@@ -334,14 +436,18 @@ int mprotect(void *addr, size_t len, int prot){
   }
 
   // dumps contents of page and moves within queues
-  dumpPage(addr, direction);
+  if (direction == 1) dumpPage(addr, direction);
   if (direction == 1) prot_in++;
   return ret_value;
 }
 
 /* 
  * Handles SIGSEGV signals by determing the page at fault, and
- * unprotecting it (which dumps and moves the page in the process)
+ * unprotecting it (which dumps and moves the page in the process).
+ * Units are only protected while all of them is read-write (see movePage),
+ * so that is the protection they get back, even if part of the unit has been
+ * unmapped since. A fault anywhere else is left to kill the program, as it
+ * would without the interposer.
  */
 void SIGSEGV_handler (int signum, siginfo_t *info, void *context){
   
@@ -351,10 +457,18 @@ void SIGSEGV_handler (int signum, siginfo_t *info, void *context){
   uintptr_t mem_address = (uintptr_t)(info->si_addr);
   uintptr_t page_addr = (uintptr_t)(mem_address & PAGEBASE_MASK);
 
+  if (info->si_code != SEGV_ACCERR || !unitProtected(page_addr)){
+    signal(SIGSEGV, SIG_DFL);
+    return;
+  }
+
   if (VALID){
     movePage((void *)page_addr, 1);
   }
-  mprotect((void *)page_addr, PAGE_SIZE, (PROT_READ | PROT_WRITE));
+  if (unitOwned(page_addr, PROT_NONE))
+    mprotect((void *)page_addr, trackSize, (PROT_READ | PROT_WRITE));
+  else
+    restoreUnit(page_addr);
   faults++;
 
 }
@@ -391,9 +505,202 @@ int dumbSearchAlgo(void *addr){
 }
 
 
+/*
+ * One line of /proc/self/maps: its address range, its protection as the "rwxp"
+ * letters, and whether it is private anonymous memory, such as the brk heap or
+ * memory malloc mapped for itself, rather than a file, stack or kernel page.
+ */
+typedef struct {
+	uintptr_t start;
+	uintptr_t end;
+	char perms[4];
+	int anonymous;
+} mapping;
+
+/*
+ * Calls visit on every mapping that overlaps [from, to), in address order,
+ * until it returns 0. /proc/self/maps is read with plain system calls, as this
+ * runs inside malloc and the SIGSEGV handler. Returns -1 if it cannot be read.
+ */
+int visitMappings(uintptr_t from, uintptr_t to, int (*visit)(const mapping *, void *), void *arg){
+	char maps[8192];
+	size_t have = 0;
+	int more = 1;
+	int fd = open("/proc/self/maps", (O_RDONLY | O_CLOEXEC));
+	if (fd < 0) return -1;
+
+	// lines are "start-end perms offset dev inode [path]"
+	while (more){
+	  ssize_t got = read(fd, maps + have, sizeof(maps) - have);
+	  if (got <= 0) break;
+	  have += got;
+
+	  char *line = maps, *newline;
+	  while (more && (newline = memchr(line, '\n', maps + have - line)) != NULL){
+	    *newline = '\0';
+	    mapping map;
+	    char *field;
+	    map.start = strtoull(line, &field, 16);
+	    map.end = strtoull(field + 1, &field, 16);
+	    if (map.start >= to){
+	      more = 0;
+	    }
+	    else if (map.end > from){
+	      memcpy(map.perms, field + 1, 4);
+	      strtoull(field + 6, &field, 16);		// offset
+	      field = strchr(field + 1, ' ');		// dev
+	      unsigned long long inode = strtoull(field, &field, 10);
+	      while (*field == ' ') field++;
+	      map.anonymous = map.perms[3] == 'p' && inode == 0 &&
+		(*field == '\0' || strcmp(field, "[heap]") == 0 || strncmp(field, "[anon:", 6) == 0);
+	      more = visit(&map, arg);
+	    }
+	    line = newline + 1;
+	  }
+	  have -= line - maps;
+	  if (have == sizeof(maps)) break;	// a line longer than any path
+	  memmove(maps, line, have);
+	}
+	close(fd);
+	return 0;
+}
+
+/*
+ * A unit is owned when the first mapping that overlaps it is anonymous, holds
+ * all of it and has exactly the protection asked for.
+ */
+typedef struct {
+	uintptr_t unit;
+	char perms[4];
+	int owned;
+} ownership;
+
+int checkOwner(const mapping *map, void *arg){
+	ownership *check = (ownership *)arg;
+	check->owned = map->anonymous && map->start <= check->unit && check->unit + trackSize <= map->end &&
+	  memcmp(map->perms, check->perms, 4) == 0;
+	return 0;
+}
+
+/*
+ * Checks that the aligned unit holding addr lies entirely within one private,
+ * anonymous mapping whose protection is exactly prot, and holds none of the
+ * interposer's own memory. Only such units are protected and dumped: the unit
+ * around a chunk can be larger than the chunk's own mapping, and cover a
+ * library right next to it, the program's data, unmapped holes, or the queues,
+ * which the kernel may merge into the same mapping as the chunk.
+ *
+ * A unit of one base page never straddles mappings and only ever holds
+ * allocations, so at the default granularity it only has to be still mapped,
+ * which free() may have undone, and the maps are not read. The last unit
+ * rejected at read-write is remembered, so a run of allocations in it does not
+ * read them again each time.
+ */
+static page_num_type foreignUnit = 0;
+
+int unitOwned(uintptr_t addr, int prot){
+	uintptr_t unit = addr & PAGEBASE_MASK;
+	uintptr_t unitEnd = unit + trackSize;
+	if (trackSize <= basePageSize){
+	  unsigned char resident;
+	  return mincore((void *)unit, trackSize, &resident) == 0;
+	}
+
+	if (PAGENUM(unit) >= protectedUnitsCount) return 0;
+	if (prot == (PROT_READ | PROT_WRITE) && foreignUnit == PAGENUM(unit)) return 0;
+	if (unit < (uintptr_t)mem + QUEUE_REGION_SIZE && (uintptr_t)mem < unitEnd) return 0;
+	if (unit < (uintptr_t)protectedUnits + protectedUnitsCount/8 && (uintptr_t)protectedUnits < unitEnd) return 0;
+
+	ownership check = { unit, { (prot & PROT_READ) ? 'r' : '-', (prot & PROT_WRITE) ? 'w' : '-',
+				    (prot & PROT_EXEC) ? 'x' : '-', 'p' }, 0 };
+	visitMappings(unit, unitEnd, &checkOwner, &check);
+
+	if (!check.owned && prot == (PROT_READ | PROT_WRITE)) foreignUnit = PAGENUM(unit);
+	return check.owned;
+}
+
+/*
+ * Records that movePage protected the unit holding addr. Bits are never
+ * cleared, since another thread may be faulting on the unit while one restores
+ * it; a unit once protected stays the interposer's to unprotect.
+ */
+void markProtected(uintptr_t addr){
+	if (protectedUnits == NULL) return;
+	page_num_type unit = PAGENUM(addr);
+	__atomic_fetch_or(&protectedUnits[unit / 64], 1ULL << (unit % 64), __ATOMIC_RELAXED);
+}
+
+int unitProtected(uintptr_t addr){
+	if (trackSize <= basePageSize) return 1;
+	if (protectedUnits == NULL) return 0;
+	page_num_type unit = PAGENUM(addr);
+	return unit < protectedUnitsCount && (__atomic_load_n(&protectedUnits[unit / 64], __ATOMIC_RELAXED) >> (unit % 64)) & 1;
+}
+
+/*
+ * Gives read-write back to what is left of a protected unit after the program
+ * unmapped part of it, one mapping at a time, as mprotect() stops at a hole.
+ */
+int restoreMapping(const mapping *map, void *arg){
+	uintptr_t unit = *(uintptr_t *)arg;
+	if (map->anonymous && memcmp(map->perms, "---p", 4) == 0){
+	  uintptr_t start = map->start > unit ? map->start : unit;
+	  uintptr_t end = map->end < unit + trackSize ? map->end : unit + trackSize;
+	  mprotect((void *)start, end - start, (PROT_READ | PROT_WRITE));
+	}
+	return 1;
+}
+
+void restoreUnit(uintptr_t addr){
+	uintptr_t unit = addr & PAGEBASE_MASK;
+	visitMappings(unit, unit + trackSize, &restoreMapping, &unit);
+}
+
+
 //============================== INITIALIZATIONS ==============================
 
 
+/*
+ * Reads the tracking granularity from TRACK_SIZE, given in bytes with an optional
+ * K, M or G suffix. It must be a power of two and at least the base page size,
+ * otherwise the 4 KB default is kept.
+ */
+void setTrackSize(){
+	basePageSize = (size_t)sysconf(_SC_PAGESIZE);
+	char *value = getenv("TRACK_SIZE");
+	if (value == NULL) return;
+
+	char *suffix;
+	unsigned long long size = strtoull(value, &suffix, 10);
+	if (*suffix == 'K' || *suffix == 'k') size <<= 10;
+	else if (*suffix == 'M' || *suffix == 'm') size <<= 20;
+	else if (*suffix == 'G' || *suffix == 'g') size <<= 30;
+
+	if (size < basePageSize || (size & (size - 1)) != 0){
+	  printf("TRACK_SIZE %s is not a power of two of at least one page, using %d\n", value, DEFAULT_TRACK_SIZE);
+	  return;
+	}
+	trackSize = (size_t)size;
+	trackShift = __builtin_ctzll(size);
+}
+
+
+/*
+ * Runs in the child after a fork. The child keeps the queues and page protections
+ * it inherited, which match its copy of the address space, but must stop writing
+ * to its parent's shard and start one of its own.
+ */
+void forkChild(){
+	__atomic_clear(&dumpLock, __ATOMIC_RELEASE);
+	close(file);
+	empties = 0;
+	faults = 0;
+	prot_in = 0;
+	dumpRetries = 0;
+	file = openShard();
+}
+
+
 /*
  * Runs when the library is linked and sets up the SIGSEGV handling and queues
  */
@@ -407,48 +714,43 @@ void _init_(){
 
 	sigaction(SIGSEGV, &sigact, NULL);
 
+	setTrackSize();
+
 	// set up the pointers to the HOT and COLD queues
-	mem = (page_num_type *)mmap(NULL, sizeof(page_num_type)*1000000, (PROT_READ | PROT_WRITE), 
+	mem = (page_num_type *)mmap(NULL, QUEUE_REGION_SIZE, (PROT_READ | PROT_WRITE), 
 	(MAP_PRIVATE | MAP_ANONYMOUS), -1, 0);
 
 	queueSizeHOT = strtol(getenv("QUEUE_SIZE"), NULL, 10);
 
+	if (trackSize > basePageSize){
+	  protectedUnitsCount = (page_num_type)1 << (USER_ADDRESS_BITS - trackShift);
+	  protectedUnits = (uint64_t *)mmap(NULL, protectedUnitsCount/8 + sizeof(uint64_t), (PROT_READ | PROT_WRITE),
+	  (MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE), -1, 0);
+	  if (protectedUnits == MAP_FAILED){
+	    protectedUnits = NULL;
+	    protectedUnitsCount = 0;	// nothing can be protected then
+	  }
+	}
+
 	queueHOTf = mem;
 	queueCOLDf = (queueHOTf + sizeof(page_num_type)*(queueSizeHOT+1));
 	queueCOLDb = queueCOLDf;
 
-	pid_t idn = getpid();
-	char id[sizeof(idn)];
-	int i = 0;
-	while (idn != 0){
-	  int temp = idn%10;
-	  id[i++] = temp+48;
-	  idn = idn/10;
-	}
 	extern char *program_invocation_short_name;
 	
 	//printf("\n%s\n", program_invocation_short_name);
-	char fileName[73+35+1] = {'/','h','o','m','e','/','c','l','a','s','s','1','7','/','m','m','a','c','o','y','1','7','/','T','h','e','s','i','s','T','e','s','t','C','o','d','e',
-				 '/','i','n','t','e','r','p','o','s','i','t','i','o','n','-','l','i','b','r','a','r','y','/','S','P','E','C','_','D','u','m','p','.','t','x','t'};
-	/*int j;
-	for (j=0; j<i; j++){
-	  fileName[73+j] = id[j];
-	  }*/
-	int j=0;
-	while (program_invocation_short_name[j] != '\0'){
-	  fileName[73+j] = program_invocation_short_name[j];
-	  j++;
-	}
-	fileName[73+j] = '\0';
+	snprintf(dumpBase, sizeof(dumpBase), "%s/SPEC_Dump.txt%s", DUMP_DIR, program_invocation_short_name);
+	int j = strlen(program_invocation_short_name);
 	
 	if (j>=25 || program_invocation_short_name[0] != 's'){
 	  VALID = 1;
-	  file = open(&fileName, (O_RDWR | O_CREAT | O_APPEND), (S_IRUSR | S_IWUSR));
+	  file = openShard();
+	  pthread_atfork(NULL, NULL, &forkChild);
 	}
 	else{
 	  VALID = 0;
-	  //file = open("/home/class17/mmacoy17/ThesisTestCode/interposition-library/SPEC_Dump.txt", (O_RDWR | O_CREAT | O_APPEND), (S_IRUSR | S_IWUSR)); //74 chars
-	//add_file = open("/home/class17/mmacoy17/ThesisTestCode/interposition-library/mem_address_Dump.txt", (O_RDWR | O_CREAT), (S_IRUSR | S_IWUSR));
+	  //file = open(DUMP_DIR "/SPEC_Dump.txt", (O_RDWR | O_CREAT | O_APPEND), (S_IRUSR | S_IWUSR));
+	//add_file = open(DUMP_DIR "/mem_address_Dump.txt", (O_RDWR | O_CREAT), (S_IRUSR | S_IWUSR));
 
 	}
 }
@@ -0,0 +1,234 @@
+/* =============================================================================================================================== */
+/**
+ * \file result_cache.h
+ * \brief A content-addressed cache of Framework's per-page results.
+ *
+ * Traces hold many byte-identical pages: zero pages, and unchanged pages dumped again on every move between the hot and cold
+ * lists.  The cache maps a 128-bit hash of a page's contents to a fixed-size value (Framework stores the page's results for every
+ * codec), so that a repeated page can be served without compressing it again.  Two pages are taken to be identical when their
+ * hashes are, which for any realistic trace length is never wrong by chance.
+ *
+ * Entries are spread over RESULT_CACHE_SHARDS shards by hash, each with its own lock, bucket chains and LRU list, so that
+ * worker threads rarely contend.  Each shard holds a fixed number of entries in arrays allocated up front; when it is full, the
+ * least recently used entry is replaced.
+ **/
+/* =============================================================================================================================== */
+#if !defined (_RESULT_CACHE_H)
+#define _RESULT_CACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESULT_CACHE_SHARDS 16
+#define RESULT_CACHE_NONE   -1
+
+typedef struct {
+  uint64_t hash[2];
+  int32_t  newer, older;    /* LRU list */
+  int32_t  chain;           /* next entry in the same bucket */
+} result_cache_entry;
+
+typedef struct {
+  pthread_mutex_t    lock;
+  result_cache_entry *entries;
+  char               *values;
+  int32_t            *buckets;
+  uint32_t           bucket_mask;
+  int32_t            capacity;
+  int32_t            used;
+  int32_t            newest, oldest;
+  long long          lookups;
+  long long          hits;
+} result_cache_shard;
+
+typedef struct {
+  size_t             value_size;
+  result_cache_shard shards[RESULT_CACHE_SHARDS];
+} result_cache;
+
+/* =============================================================================================================================== */
+/* HASHING */
+#define RESULT_CACHE_PRIME1 0x9e3779b185ebca87ULL
+#define RESULT_CACHE_PRIME2 0xc2b2ae3d27d4eb4fULL
+
+static inline uint64_t result_cache_round(uint64_t lane, uint64_t word){
+  lane += word*RESULT_CACHE_PRIME2;
+  lane = (lane << 31) | (lane >> 33);
+  return lane*RESULT_CACHE_PRIME1;
+}
+
+static inline uint64_t result_cache_mix(uint64_t value){
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ULL;
+  value ^= value >> 33;
+  return value;
+}
+
+/**
+ * Hash count words into 128 bits.  Four independent lanes keep the multiplier busy.
+ **/
+static inline void result_cache_hash(const uint64_t *words, size_t count, uint64_t hash[2]){
+  uint64_t lanes[4] = {RESULT_CACHE_PRIME1, RESULT_CACHE_PRIME2, 0, (uint64_t)0 - RESULT_CACHE_PRIME1};
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+    for (int l = 0; l < 4; l++)
+      lanes[l] = result_cache_round(lanes[l], words[i + l]);
+  for (; i < count; i++)
+    lanes[i % 4] = result_cache_round(lanes[i % 4], words[i]);
+  hash[0] = result_cache_mix(lanes[0] ^ result_cache_mix(lanes[1]) ^ (lanes[2] << 1) ^ count);
+  hash[1] = result_cache_mix(lanes[3] ^ result_cache_mix(lanes[2]) ^ (lanes[1] << 1) ^ count);
+}
+
+/* =============================================================================================================================== */
+/* CACHE */
+/**
+ * Set up a cache for at least capacity entries of value_size bytes each.
+ *
+ * \return 0 on success, -1 if the memory cannot be had.
+ **/
+static inline int result_cache_init(result_cache *cache, long long capacity, size_t value_size){
+  int32_t per_shard = (int32_t)((capacity + RESULT_CACHE_SHARDS - 1)/RESULT_CACHE_SHARDS);
+  uint32_t buckets = 1;
+  while (buckets < (uint32_t)per_shard)
+    buckets <<= 1;
+  cache->value_size = value_size;
+  for (int s = 0; s < RESULT_CACHE_SHARDS; s++){
+    result_cache_shard *shard = &cache->shards[s];
+    pthread_mutex_init(&shard->lock, NULL);
+    shard->entries = (result_cache_entry *)malloc(sizeof(result_cache_entry)*per_shard);
+    shard->values = (char *)malloc(value_size*per_shard);
+    shard->buckets = (int32_t *)malloc(sizeof(int32_t)*buckets);
+    if (shard->entries == NULL || shard->values == NULL || shard->buckets == NULL)
+      return -1;
+    for (uint32_t b = 0; b < buckets; b++)
+      shard->buckets[b] = RESULT_CACHE_NONE;
+    shard->bucket_mask = buckets - 1;
+    shard->capacity = per_shard;
+    shard->used = 0;
+    shard->newest = shard->oldest = RESULT_CACHE_NONE;
+    shard->lookups = shard->hits = 0;
+  }
+  return 0;
+}
+
+static inline void result_cache_free(result_cache *cache){
+  for (int s = 0; s < RESULT_CACHE_SHARDS; s++){
+    free(cache->shards[s].entries);
+    free(cache->shards[s].values);
+    free(cache->shards[s].buckets);
+    pthread_mutex_destroy(&cache->shards[s].lock);
+  }
+}
+
+static inline result_cache_shard *result_cache_shard_of(result_cache *cache, const uint64_t hash[2]){
+  return &cache->shards[hash[1] % RESULT_CACHE_SHARDS];
+}
+
+static inline int32_t *result_cache_bucket(result_cache_shard *shard, const uint64_t hash[2]){
+  return &shard->buckets[hash[0] & shard->bucket_mask];
+}
+
+/* Take an entry out of the LRU list. */
+static inline void result_cache_unlink(result_cache_shard *shard, int32_t e){
+  result_cache_entry *entry = &shard->entries[e];
+  if (entry->newer != RESULT_CACHE_NONE)
+    shard->entries[entry->newer].older = entry->older;
+  else
+    shard->newest = entry->older;
+  if (entry->older != RESULT_CACHE_NONE)
+    shard->entries[entry->older].newer = entry->newer;
+  else
+    shard->oldest = entry->newer;
+}
+
+/* Put an entry at the head of the LRU list. */
+static inline void result_cache_touch(result_cache_shard *shard, int32_t e){
+  result_cache_entry *entry = &shard->entries[e];
+  entry->newer = RESULT_CACHE_NONE;
+  entry->older = shard->newest;
+  if (shard->newest != RESULT_CACHE_NONE)
+    shard->entries[shard->newest].newer = e;
+  shard->newest = e;
+  if (shard->oldest == RESULT_CACHE_NONE)
+    shard->oldest = e;
+}
+
+static inline int32_t result_cache_find(result_cache_shard *shard, const uint64_t hash[2]){
+  int32_t e = *result_cache_bucket(shard, hash);
+  while (e != RESULT_CACHE_NONE &&
+         (shard->entries[e].hash[0] != hash[0] || shard->entries[e].hash[1] != hash[1]))
+    e = shard->entries[e].chain;
+  return e;
+}
+
+/**
+ * Look up the value stored for a hash and copy it to value.
+ *
+ * \return 1 on a hit, 0 on a miss.
+ **/
+static inline int result_cache_lookup(result_cache *cache, const uint64_t hash[2], void *value){
+  result_cache_shard *shard = result_cache_shard_of(cache, hash);
+  pthread_mutex_lock(&shard->lock);
+  shard->lookups++;
+  int32_t e = result_cache_find(shard, hash);
+  if (e != RESULT_CACHE_NONE){
+    shard->hits++;
+    result_cache_unlink(shard, e);
+    result_cache_touch(shard, e);
+    memcpy(value, shard->values + (size_t)e*cache->value_size, cache->value_size);
+  }
+  pthread_mutex_unlock(&shard->lock);
+  return e != RESULT_CACHE_NONE;
+}
+
+/**
+ * Store the value for a hash, replacing the least recently used entry of its shard if the shard is full.  Another thread may
+ * have stored the same hash since it was looked up; the value already there is kept.
+ **/
+static inline void result_cache_insert(result_cache *cache, const uint64_t hash[2], const void *value){
+  result_cache_shard *shard = result_cache_shard_of(cache, hash);
+  pthread_mutex_lock(&shard->lock);
+  if (result_cache_find(shard, hash) != RESULT_CACHE_NONE){
+    pthread_mutex_unlock(&shard->lock);
+    return;
+  }
+
+  int32_t e;
+  if (shard->used < shard->capacity)
+    e = shard->used++;
+  else {
+    e = shard->oldest;
+    result_cache_unlink(shard, e);
+    int32_t *link = result_cache_bucket(shard, shard->entries[e].hash);
+    while (*link != e)
+      link = &shard->entries[*link].chain;
+    *link = shard->entries[e].chain;
+  }
+
+  result_cache_entry *entry = &shard->entries[e];
+  entry->hash[0] = hash[0];
+  entry->hash[1] = hash[1];
+  int32_t *bucket = result_cache_bucket(shard, hash);
+  entry->chain = *bucket;
+  *bucket = e;
+  result_cache_touch(shard, e);
+  memcpy(shard->values + (size_t)e*cache->value_size, value, cache->value_size);
+  pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * Totals over all shards.  Only meaningful once the threads using the cache are done.
+ **/
+static inline void result_cache_stats(const result_cache *cache, long long *lookups, long long *hits){
+  *lookups = *hits = 0;
+  for (int s = 0; s < RESULT_CACHE_SHARDS; s++){
+    *lookups += cache->shards[s].lookups;
+    *hits += cache->shards[s].hits;
+  }
+}
+
+#endif /* _RESULT_CACHE_H */
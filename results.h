@@ -0,0 +1,47 @@
+/* =============================================================================================================================== */
+/**
+ * \file results.h
+ * \brief The records of the results files that Framework writes and Simulator reads.
+ *
+ * They depend on nothing but the word size, so that Simulator builds without any of the codecs.  The layout of the file around
+ * them, its header and table of codecs, is described in trace.h.
+ **/
+/* =============================================================================================================================== */
+#if !defined (_RESULTS_H)
+#define _RESULTS_H
+
+#include "WK.h"
+
+typedef struct{
+  WK_word       address;
+  unsigned int  comp_size;
+  long long     comp_time;
+  long long     decomp_time;
+  long long     timestamp;    // CLOCK_MONOTONIC ns at which the page moved, 0 if the trace has no timestamps
+  unsigned int  tid;          // thread that touched (or evicted) the page
+} page_info;
+
+// Records of results files written before version 3, which carried no timestamps
+typedef struct{
+  WK_word       address;
+  unsigned int  comp_size;
+  long long     comp_time;
+  long long     decomp_time;
+} page_info_v2;
+
+// Records of results files from version 4 on: the page, followed by one
+// codec_result per codec named in the file's results_codecs table
+typedef struct{
+  WK_word       address;
+  long long     timestamp;
+  unsigned int  tid;
+  unsigned int  reserved;     // always 0, so that equal runs write byte-identical files
+} page_record;
+
+typedef struct{
+  unsigned int  comp_size;
+  long long     comp_time;
+  long long     decomp_time;
+} codec_result;
+
+#endif /* _RESULTS_H */
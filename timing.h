@@ -0,0 +1,161 @@
+/* =============================================================================================================================== */
+/**
+ * \file timing.h
+ * \brief Low-noise timing of single codec calls for Framework.
+ *
+ * A single compress or decompress call takes well under a microsecond for many pages, which is close to the cost and jitter of
+ * clock_gettime() itself.  The timer here can read either the thread's CPU clock (the default, as before) or the time stamp
+ * counter, serialized so that the call being timed can neither start before the first read nor finish after the second.  TSC
+ * ticks are converted to nanoseconds with a rate calibrated against CLOCK_MONOTONIC at startup.
+ *
+ * The cost of a back-to-back pair of reads is measured once and subtracted from every sample, and a call can be timed K times
+ * and summarized by the minimum (the least disturbed run) or the median.  timing_evict() flushes buffers before a call that
+ * should be timed with a cold cache.
+ **/
+/* =============================================================================================================================== */
+#if !defined (_TIMING_H)
+#define _TIMING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TIMING_HAVE_TSC 1
+#endif
+
+#define TIMING_CLOCK 0   /* CLOCK_THREAD_CPUTIME_ID */
+#define TIMING_TSC   1   /* serialized RDTSC */
+
+#define TIMING_MIN    0
+#define TIMING_MEDIAN 1
+
+#define TIMING_MAX_REPEATS 64
+
+typedef struct {
+  int    source;          /* TIMING_CLOCK or TIMING_TSC */
+  int    repeats;         /* times each call is made, at most TIMING_MAX_REPEATS */
+  int    statistic;       /* TIMING_MIN or TIMING_MEDIAN over the repeats */
+  double ns_per_tick;
+  int64_t overhead;       /* ticks taken by a start/stop pair with nothing between */
+} timing_engine;
+
+/**
+ * Read the timer at the start of a timed region.  With the TSC, the fence keeps earlier instructions from leaking into the region.
+ **/
+static inline uint64_t timing_start(const timing_engine *timer){
+#ifdef TIMING_HAVE_TSC
+  if (timer->source == TIMING_TSC){
+    _mm_lfence();
+    uint64_t ticks = __rdtsc();
+    _mm_lfence();
+    return ticks;
+  }
+#endif
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return (uint64_t)now.tv_sec*1000000000 + now.tv_nsec;
+}
+
+/**
+ * Read the timer at the end of a timed region.  RDTSCP waits for the region to finish, the fence keeps later instructions out.
+ **/
+static inline uint64_t timing_stop(const timing_engine *timer){
+#ifdef TIMING_HAVE_TSC
+  if (timer->source == TIMING_TSC){
+    unsigned int cpu;
+    uint64_t ticks = __rdtscp(&cpu);
+    _mm_lfence();
+    return ticks;
+  }
+#endif
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return (uint64_t)now.tv_sec*1000000000 + now.tv_nsec;
+}
+
+static inline uint64_t timing_monotonic_ns(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec*1000000000 + now.tv_nsec;
+}
+
+static inline int timing_compare(const void *a, const void *b){
+  int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Set up a timer: calibrate the TSC against CLOCK_MONOTONIC over about 50 ms and measure the overhead of an empty region.
+ *
+ * \return 0 on success, -1 if the TSC was asked for on a machine without one.
+ **/
+static inline int timing_init(timing_engine *timer, int source, int repeats, int statistic){
+  timer->source = source;
+  timer->repeats = repeats < 1 ? 1 : (repeats > TIMING_MAX_REPEATS ? TIMING_MAX_REPEATS : repeats);
+  timer->statistic = statistic;
+  timer->ns_per_tick = 1.0;
+  timer->overhead = 0;
+
+  if (source == TIMING_TSC){
+#ifdef TIMING_HAVE_TSC
+    uint64_t start_ns = timing_monotonic_ns(), start_ticks = timing_start(timer);
+    while (timing_monotonic_ns() - start_ns < 50000000)
+      ;
+    uint64_t end_ns = timing_monotonic_ns(), end_ticks = timing_stop(timer);
+    timer->ns_per_tick = (double)(end_ns - start_ns)/(double)(end_ticks - start_ticks);
+#else
+    return -1;
+#endif
+  }
+
+  int64_t least = INT64_MAX;
+  for (int i = 0; i < 10000; i++){
+    uint64_t start = timing_start(timer);
+    int64_t elapsed = (int64_t)(timing_stop(timer) - start);
+    if (elapsed < least)
+      least = elapsed;
+  }
+  timer->overhead = least;
+  return 0;
+}
+
+/**
+ * Turn the tick counts of the repeats of one call into nanoseconds: overhead removed, then the minimum or median.  Sorts samples.
+ * A call is always made at least once, and without samples there is no time to report.
+ **/
+static inline long long timing_summarize(const timing_engine *timer, int64_t *samples, int count){
+  if (count < 1)
+    return 0;
+  for (int i = 0; i < count; i++)
+    samples[i] = samples[i] > timer->overhead ? samples[i] - timer->overhead : 0;
+  int64_t ticks;
+  if (count == 1)
+    ticks = samples[0];
+  else if (timer->statistic == TIMING_MEDIAN){
+    qsort(samples, count, sizeof(int64_t), timing_compare);
+    ticks = samples[count/2];
+  }
+  else {
+    ticks = samples[0];
+    for (int i = 1; i < count; i++)
+      if (samples[i] < ticks)
+        ticks = samples[i];
+  }
+  return (long long)(ticks*timer->ns_per_tick + 0.5);
+}
+
+/**
+ * Evict a buffer from every level of cache, so that the next timed call finds it cold.  Only available with TIMING_HAVE_TSC, i.e.
+ * on x86, where CLFLUSH is.
+ **/
+static inline void timing_evict(const void *buf, size_t bytes){
+#ifdef TIMING_HAVE_TSC
+  for (size_t line = 0; line < bytes; line += 64)
+    _mm_clflush((const char *)buf + line);
+  _mm_mfence();
+#endif
+}
+
+#endif /* _TIMING_H */
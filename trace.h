@@ -0,0 +1,251 @@
+/* =============================================================================================================================== */
+/**
+ * \file trace.h
+ * \brief On-disk layout shared by the interposer (memoryFunctions.c), Framework and Simulator.
+ *
+ * Both the page dumps written by the interposer and the page_info results written by Framework begin with a trace_header.  The
+ * header carries the tracking granularity, i.e. the number of bytes dumped for each record and the unit that Simulator accounts
+ * memory in.  Files written before the header existed start directly with a record; readers detect that by the missing magic
+ * number and fall back to the legacy 4 KB granularity.
+ *
+ * Every traced process writes its own shard, tagged in the header with its pid and the time it started tracing, so forked
+ * workers never share a file descriptor.  TraceMerge combines the shards of one run into a single trace.
+ *
+ * Each record of a page dump is the page number (with the direction in bit 63), then, if the header has TRACE_FLAG_TIMESTAMPS,
+ * the time and thread of the event, then the contents of the page.  Time and thread are stored as zigzag varint deltas from the
+ * previous record of the file (the first record is relative to start_ns and pid), which usually takes three or four bytes.
+ *
+ * From version 4 on, the header of a results file is followed by a results_codecs table naming the codecs Framework ran, and each
+ * record holds one result per codec in the order of the table.
+ **/
+/* =============================================================================================================================== */
+#if !defined (_TRACE_H)
+#define _TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Magic numbers that open a page dump ("IMPTRACE") and a Framework results file ("IMPRSLTS").  Neither can be mistaken for a
+ * legacy record's leading page number, which never has bits 36-62 set.
+ **/
+#define TRACE_MAGIC   0x4543415254504d49ULL
+#define RESULTS_MAGIC 0x53544c5352504d49ULL
+#define TRACE_VERSION 4
+/**
+ * Header flags.
+ **/
+#define TRACE_FLAG_TIMESTAMPS 0x1
+/**
+ * The granularity of traces written before the header was introduced: one Linux small page.
+ **/
+#define TRACE_LEGACY_GRANULARITY 4096
+/**
+ * A merged trace keeps pages of different processes apart by tagging each page number with the index of the shard it came from.
+ * Page numbers of a 48-bit address space never reach these bits, and the direction bit (63) is left alone.
+ **/
+#define TRACE_SHARD_SHIFT 48
+#define TRACE_SHARD_MASK  0x7fff000000000000ULL
+#define TRACE_MAX_SHARDS  (TRACE_SHARD_MASK >> TRACE_SHARD_SHIFT)
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t flags;        /* TRACE_FLAG_..., 0 before version 3 */
+  uint64_t granularity;  /* bytes covered by each tracked unit, a power of two */
+  /* version 2 */
+  uint32_t pid;          /* process that wrote the shard, 0 for merged traces and results */
+  uint32_t ppid;         /* its parent, to reconstruct the fork tree */
+  uint64_t start_ns;     /* CLOCK_MONOTONIC time at which the shard was opened */
+} trace_header;
+
+/* Size of the header as written by each version. */
+#define TRACE_HEADER_V1_SIZE 24
+#define TRACE_HEADER_SIZE(version) ((version) < 2 ? TRACE_HEADER_V1_SIZE : sizeof(trace_header))
+
+static inline void trace_init_header(trace_header *header, uint64_t magic, uint64_t granularity){
+  header->magic = magic;
+  header->version = TRACE_VERSION;
+  header->flags = 0;
+  header->granularity = granularity;
+  header->pid = 0;
+  header->ppid = 0;
+  header->start_ns = 0;
+}
+
+/**
+ * Read the header at the front of a trace.  Headerless (legacy) files are rewound so that the first record is read next, and
+ * reported with the legacy granularity.
+ *
+ * \return 0 on success, -1 if the file was written by a newer version of the tools or cannot be rewound.
+ **/
+static inline int trace_read_header(FILE *file, uint64_t magic, trace_header *header){
+  long start = ftell(file);
+  if (fread(header, TRACE_HEADER_V1_SIZE, 1, file) == 1 && header->magic == magic){
+    if (header->version > TRACE_VERSION || header->granularity == 0)
+      return -1;
+    if (header->version < 3)
+      header->flags = 0;
+    header->pid = 0;
+    header->ppid = 0;
+    header->start_ns = 0;
+    if (header->version >= 2 &&
+        fread((char *)header + TRACE_HEADER_V1_SIZE, sizeof(trace_header) - TRACE_HEADER_V1_SIZE, 1, file) != 1)
+      return -1;
+    return 0;
+  }
+  if (fseek(file, start, SEEK_SET) != 0)
+    return -1;
+  trace_init_header(header, magic, TRACE_LEGACY_GRANULARITY);
+  header->version = 0;
+  return 0;
+}
+
+/* =============================================================================================================================== */
+/* RECORD TIMESTAMPS */
+/**
+ * The most bytes a varint can take.
+ **/
+#define TRACE_MAX_VARINT 10
+/**
+ * The time and thread of the previous record, against which the next one is delta encoded.
+ **/
+typedef struct {
+  uint64_t time_ns;
+  uint32_t tid;
+} trace_clock;
+
+static inline void trace_clock_init(trace_clock *clock, const trace_header *header){
+  clock->time_ns = header->start_ns;
+  clock->tid = header->pid;
+}
+
+static inline uint64_t trace_zigzag(int64_t value){
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t trace_unzigzag(uint64_t value){
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static inline int trace_put_varint(uint8_t *buf, uint64_t value){
+  int length = 0;
+  while (value >= 0x80){
+    buf[length++] = (uint8_t)value | 0x80;
+    value >>= 7;
+  }
+  buf[length++] = (uint8_t)value;
+  return length;
+}
+
+static inline int trace_get_varint(FILE *file, uint64_t *value){
+  int shift = 0;
+  int byte;
+  *value = 0;
+  do {
+    if ((byte = getc(file)) == EOF || shift > 63)
+      return -1;
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return 0;
+}
+
+/**
+ * Encode the time and thread of a record into buf (at most 2 * TRACE_MAX_VARINT bytes) and advance the clock.
+ *
+ * \return The number of bytes written.
+ **/
+static inline int trace_encode_stamp(trace_clock *clock, uint64_t time_ns, uint32_t tid, uint8_t *buf){
+  int length = trace_put_varint(buf, trace_zigzag((int64_t)(time_ns - clock->time_ns)));
+  length += trace_put_varint(buf + length, trace_zigzag((int64_t)tid - (int64_t)clock->tid));
+  clock->time_ns = time_ns;
+  clock->tid = tid;
+  return length;
+}
+
+/**
+ * Decode a varint from memory, reading no further than end.
+ *
+ * \return The number of bytes it took, or -1 if it runs past end.
+ **/
+static inline int trace_decode_varint(const uint8_t *buf, const uint8_t *end, uint64_t *value){
+  int length = 0;
+  *value = 0;
+  do {
+    if (buf + length >= end || length >= TRACE_MAX_VARINT)
+      return -1;
+    *value |= (uint64_t)(buf[length] & 0x7f) << (7*length);
+  } while (buf[length++] & 0x80);
+  return length;
+}
+
+/**
+ * Decode the time and thread of a record from memory and advance the clock.  The inverse of trace_encode_stamp().
+ *
+ * \return The number of bytes the stamp took, or -1 if it runs past end.
+ **/
+static inline int trace_decode_stamp(trace_clock *clock, const uint8_t *buf, const uint8_t *end, uint64_t *time_ns, uint32_t *tid){
+  uint64_t time_delta, tid_delta;
+  int time_length = trace_decode_varint(buf, end, &time_delta);
+  if (time_length < 0)
+    return -1;
+  int tid_length = trace_decode_varint(buf + time_length, end, &tid_delta);
+  if (tid_length < 0)
+    return -1;
+  clock->time_ns += (uint64_t)trace_unzigzag(time_delta);
+  clock->tid = (uint32_t)((int64_t)clock->tid + trace_unzigzag(tid_delta));
+  *time_ns = clock->time_ns;
+  *tid = clock->tid;
+  return time_length + tid_length;
+}
+
+/**
+ * Read the head of the next record of a page dump: its page number and, for timestamped traces, when and by which thread it was
+ * written (0 otherwise).  The page contents, header->granularity bytes, follow.
+ *
+ * \return 0 on success, -1 at the end of the trace.
+ **/
+static inline int trace_read_record_head(FILE *file, const trace_header *header, trace_clock *clock,
+                                         uint64_t *page, uint64_t *time_ns, uint32_t *tid){
+  if (fread(page, sizeof(uint64_t), 1, file) != 1)
+    return -1;
+  *time_ns = 0;
+  *tid = 0;
+  if (header->flags & TRACE_FLAG_TIMESTAMPS){
+    uint64_t time_delta, tid_delta;
+    if (trace_get_varint(file, &time_delta) != 0 || trace_get_varint(file, &tid_delta) != 0)
+      return -1;
+    clock->time_ns += (uint64_t)trace_unzigzag(time_delta);
+    clock->tid = (uint32_t)((int64_t)clock->tid + trace_unzigzag(tid_delta));
+    *time_ns = clock->time_ns;
+    *tid = clock->tid;
+  }
+  return 0;
+}
+
+/* =============================================================================================================================== */
+/* RESULTS CODECS */
+#define RESULTS_MAX_CODECS     16
+#define RESULTS_CODEC_NAME_LEN 16
+
+typedef struct {
+  uint32_t num_codecs;
+  uint32_t reserved;
+  char     names[RESULTS_MAX_CODECS][RESULTS_CODEC_NAME_LEN];  /* NUL padded */
+} results_codecs;
+
+/**
+ * Find a codec in the table of a results file.
+ *
+ * \return Its column, or -1 if the file holds no results for it.
+ **/
+static inline int results_find_codec(const results_codecs *codecs, const char *name){
+  for (uint32_t i = 0; i < codecs->num_codecs; i++)
+    if (strncmp(codecs->names[i], name, RESULTS_CODEC_NAME_LEN) == 0)
+      return (int)i;
+  return -1;
+}
+
+#endif /* _TRACE_H */
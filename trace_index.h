@@ -0,0 +1,183 @@
+/* =============================================================================================================================== */
+/**
+ * \file trace_index.h
+ * \brief A chunk index of a page dump, so that a trace can be processed from the middle.
+ *
+ * Records of timestamped traces vary in length and their stamps are deltas from the record before, so neither the offset of the
+ * n'th record nor its time can be computed without reading everything before it.  The index notes, every TRACE_INDEX_CHUNK
+ * records, the offset of the record and the state of the trace_clock just before it.  Any chunk can then be read on its own,
+ * which lets Framework resume a run that was stopped, or split a trace into ranges of chunks that are processed side by side.
+ *
+ * The index lives next to the trace, as <trace>.idx, and is built by a pass over the record heads the first time it is needed.
+ * It records the size of the trace it describes and is rebuilt if the trace no longer has that size.
+ **/
+/* =============================================================================================================================== */
+#if !defined (_TRACE_INDEX_H)
+#define _TRACE_INDEX_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+#include "trace_map.h"
+
+#define TRACE_INDEX_MAGIC   0x58444e4954504d49ULL   /* "IMPTINDX" */
+#define TRACE_INDEX_VERSION 1
+/**
+ * Records per chunk: 64 MB of a 4 KB trace unless another value is specified outside this module.
+ **/
+#if !defined (TRACE_INDEX_CHUNK)
+#define TRACE_INDEX_CHUNK 16384
+#endif
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t chunk_records;
+  uint64_t trace_size;      /* of the trace described, to notice a stale index */
+  uint64_t records;         /* in the whole trace */
+  uint64_t num_chunks;
+} trace_index_header;
+
+typedef struct {
+  uint64_t offset;          /* of the chunk's first record */
+  uint64_t time_ns;         /* the trace_clock before that record */
+  uint32_t tid;
+  uint32_t reserved;
+} trace_index_entry;
+
+typedef struct {
+  trace_index_header header;
+  trace_index_entry  *chunks;
+} trace_index;
+
+/**
+ * Build the index of a trace by reading the head of every record, starting at map->pos, where the first record must be.  The
+ * map is left at the end of the trace.
+ *
+ * \return 0 on success, -1 if memory runs out.
+ **/
+static inline int trace_index_build(trace_index *index, trace_map *map, const trace_header *header){
+  uint64_t capacity = 64;
+  index->chunks = (trace_index_entry *)malloc(sizeof(trace_index_entry)*capacity);
+  if (index->chunks == NULL)
+    return -1;
+  index->header.magic = TRACE_INDEX_MAGIC;
+  index->header.version = TRACE_INDEX_VERSION;
+  index->header.chunk_records = TRACE_INDEX_CHUNK;
+  index->header.trace_size = map->size;
+  index->header.records = 0;
+  index->header.num_chunks = 0;
+
+  trace_clock clock;
+  trace_clock_init(&clock, header);
+  uint64_t page, time_ns;
+  uint32_t tid;
+  for (;;){
+    uint64_t offset = map->pos;
+    trace_clock before = clock;
+    if (trace_map_record_head(map, header, &clock, &page, &time_ns, &tid) != 0 ||
+        trace_map_get(map, header->granularity) == NULL)
+      break;
+    if (index->header.records % TRACE_INDEX_CHUNK == 0){
+      if (index->header.num_chunks == capacity){
+        capacity *= 2;
+        trace_index_entry *grown = (trace_index_entry *)realloc(index->chunks, sizeof(trace_index_entry)*capacity);
+        if (grown == NULL)
+          return -1;
+        index->chunks = grown;
+      }
+      trace_index_entry *entry = &index->chunks[index->header.num_chunks++];
+      entry->offset = offset;
+      entry->time_ns = before.time_ns;
+      entry->tid = before.tid;
+      entry->reserved = 0;
+      trace_map_release(map, offset);
+    }
+    index->header.records++;
+  }
+  return 0;
+}
+
+static inline int trace_index_save(const trace_index *index, const char *path){
+  FILE *file = fopen(path, "w");
+  if (file == NULL)
+    return -1;
+  int ok = fwrite(&index->header, sizeof(trace_index_header), 1, file) == 1 &&
+           fwrite(index->chunks, sizeof(trace_index_entry), index->header.num_chunks, file) == index->header.num_chunks;
+  return fclose(file) == 0 && ok ? 0 : -1;
+}
+
+/**
+ * Load an index written by trace_index_save().
+ *
+ * \return 0 on success, -1 if there is none, it cannot be read or it describes a trace of another size.
+ **/
+static inline int trace_index_load(trace_index *index, const char *path, uint64_t trace_size){
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+    return -1;
+  index->chunks = NULL;
+  if (fread(&index->header, sizeof(trace_index_header), 1, file) != 1 || index->header.magic != TRACE_INDEX_MAGIC ||
+      index->header.version != TRACE_INDEX_VERSION || index->header.chunk_records != TRACE_INDEX_CHUNK ||
+      index->header.trace_size != trace_size ||
+      (index->chunks = (trace_index_entry *)malloc(sizeof(trace_index_entry)*(index->header.num_chunks + 1))) == NULL ||
+      fread(index->chunks, sizeof(trace_index_entry), index->header.num_chunks, file) != index->header.num_chunks){
+    free(index->chunks);
+    fclose(file);
+    return -1;
+  }
+  fclose(file);
+  return 0;
+}
+
+/**
+ * Load the index of the trace at path, or build it from a mapping of the trace (whose first record is at offset) and save it
+ * for next time.  An index that cannot be saved is still returned.
+ *
+ * \return 0 on success, -1 if the trace cannot be mapped or memory runs out.
+ **/
+static inline int trace_index_open(trace_index *index, const char *path, const trace_header *header, uint64_t offset){
+  char index_path[4096];
+  snprintf(index_path, sizeof(index_path), "%s.idx", path);
+  trace_map map;
+  if (trace_map_open(&map, path, offset, TRACE_MAP_DEFAULT_WINDOW) != 0)
+    return -1;
+  int status = 0;
+  if (trace_index_load(index, index_path, map.size) != 0){
+    status = trace_index_build(index, &map, header);
+    if (status == 0 && trace_index_save(index, index_path) != 0)
+      fprintf(stderr, "Unable to save the index of %s to %s.\n", path, index_path);
+  }
+  trace_map_close(&map);
+  return status;
+}
+
+/**
+ * Move a map and the clock reading it to the record'th record of the trace.
+ *
+ * \return 0 on success, -1 if the trace holds no such record.
+ **/
+static inline int trace_index_seek(const trace_index *index, uint64_t record, trace_map *map, const trace_header *header,
+                                   trace_clock *clock){
+  if (record >= index->header.records)
+    return -1;
+  const trace_index_entry *entry = &index->chunks[record/TRACE_INDEX_CHUNK];
+  trace_map_seek(map, entry->offset);
+  clock->time_ns = entry->time_ns;
+  clock->tid = entry->tid;
+  uint64_t page, time_ns;
+  uint32_t tid;
+  for (uint64_t skip = record % TRACE_INDEX_CHUNK; skip > 0; skip--)
+    if (trace_map_record_head(map, header, clock, &page, &time_ns, &tid) != 0 ||
+        trace_map_get(map, header->granularity) == NULL)
+      return -1;
+  return 0;
+}
+
+static inline void trace_index_free(trace_index *index){
+  free(index->chunks);
+}
+
+#endif /* _TRACE_INDEX_H */
@@ -0,0 +1,152 @@
+/* =============================================================================================================================== */
+/**
+ * \file trace_map.h
+ * \brief Zero-copy reading of traces and results files through mmap.
+ *
+ * The whole file is mapped read-only once, and readers are handed pointers straight into the mapping instead of copies made by
+ * fread.  Traces are often larger than RAM, so the file is walked in windows aligned to huge pages: the window ahead of the
+ * reader is prefetched with MADV_WILLNEED, and windows the caller is done with are unmapped with MADV_DONTNEED.  That only drops
+ * this process's page tables; the page cache keeps the pages, so for a trace larger than RAM the released windows are also evicted
+ * with POSIX_FADV_DONTNEED, lest they crowd other pages out.  Smaller traces stay cached for the next run.  Callers that keep
+ * pointers alive after reading past them (e.g. Framework's worker threads) release explicitly with trace_map_release() once they
+ * are finished.
+ **/
+/* =============================================================================================================================== */
+#if !defined (_TRACE_MAP_H)
+#define _TRACE_MAP_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trace.h"
+
+/**
+ * Windows are a multiple of the 2 MB huge page, and the default is large enough that readahead keeps a fast device busy.
+ **/
+#define TRACE_MAP_ALIGN          (2ULL << 20)
+#define TRACE_MAP_DEFAULT_WINDOW (64ULL << 20)
+
+typedef struct {
+  int            fd;
+  const uint8_t  *base;       /* the whole file */
+  uint64_t       size;
+  uint64_t       pos;         /* offset of the next byte to read */
+  uint64_t       window;      /* bytes prefetched and released at a time */
+  uint64_t       ahead;       /* end of the prefetched part of the file */
+  uint64_t       released;    /* start of the part of the file still needed */
+  int            uncache;     /* whether released windows are evicted from the page cache too */
+} trace_map;
+
+/**
+ * Map a file for reading from the given offset, e.g. the end of a header read with trace_read_header().
+ *
+ * \return 0 on success, -1 if the file cannot be opened or mapped.
+ **/
+static inline int trace_map_open(trace_map *map, const char *path, uint64_t offset, uint64_t window){
+  struct stat info;
+  map->fd = open(path, O_RDONLY);
+  if (map->fd < 0)
+    return -1;
+  if (fstat(map->fd, &info) != 0 || (uint64_t)info.st_size < offset){
+    close(map->fd);
+    return -1;
+  }
+  map->size = info.st_size;
+  map->uncache = map->size > (uint64_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+  map->base = NULL;
+  if (map->size > 0){
+    map->base = (const uint8_t *)mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, map->fd, 0);
+    if (map->base == MAP_FAILED){
+      close(map->fd);
+      return -1;
+    }
+    madvise((void *)map->base, map->size, MADV_SEQUENTIAL);
+  }
+  map->window = window < TRACE_MAP_ALIGN ? TRACE_MAP_ALIGN : window & ~(TRACE_MAP_ALIGN - 1);
+  map->pos = offset;
+  map->ahead = offset & ~(TRACE_MAP_ALIGN - 1);
+  map->released = map->ahead;
+  return 0;
+}
+
+static inline void trace_map_close(trace_map *map){
+  if (map->base != NULL)
+    munmap((void *)map->base, map->size);
+  close(map->fd);
+}
+
+/**
+ * Keep at least a window of the file ahead of offset in flight.
+ **/
+static inline void trace_map_prefetch(trace_map *map, uint64_t offset){
+  while (map->ahead < map->size && map->ahead < offset + map->window){
+    uint64_t length = map->size - map->ahead < map->window ? map->size - map->ahead : map->window;
+    madvise((void *)(map->base + map->ahead), length, MADV_WILLNEED);
+    map->ahead += length;
+  }
+}
+
+/**
+ * Drop the whole windows that lie before offset from the mapping, and from the page cache if the trace is larger than RAM.
+ * Pointers into them must no longer be used.
+ **/
+static inline void trace_map_release(trace_map *map, uint64_t offset){
+  uint64_t end = offset - offset % map->window;
+  if (end > map->released){
+    madvise((void *)(map->base + map->released), end - map->released, MADV_DONTNEED);
+    if (map->uncache)
+      posix_fadvise(map->fd, map->released, end - map->released, POSIX_FADV_DONTNEED);
+    map->released = end;
+  }
+}
+
+/**
+ * Continue reading at offset, e.g. the start of a chunk found in a trace_index.  Nothing before offset is prefetched or released.
+ **/
+static inline void trace_map_seek(trace_map *map, uint64_t offset){
+  map->pos = offset;
+  map->ahead = offset & ~(TRACE_MAP_ALIGN - 1);
+  map->released = map->ahead;
+  trace_map_prefetch(map, offset);
+}
+
+/**
+ * Take the next length bytes of the file.
+ *
+ * \return A pointer into the mapping, or NULL if fewer than length bytes are left.
+ **/
+static inline const void *trace_map_get(trace_map *map, uint64_t length){
+  if (map->size - map->pos < length)
+    return NULL;
+  const void *data = map->base + map->pos;
+  map->pos += length;
+  trace_map_prefetch(map, map->pos);
+  return data;
+}
+
+/**
+ * The mapped counterpart of trace_read_record_head(): read the head of the next record of a page dump.  The page contents,
+ * header->granularity bytes, can then be taken with trace_map_get().
+ *
+ * \return 0 on success, -1 at the end of the trace.
+ **/
+static inline int trace_map_record_head(trace_map *map, const trace_header *header, trace_clock *clock,
+                                        uint64_t *page, uint64_t *time_ns, uint32_t *tid){
+  const uint64_t *number = (const uint64_t *)trace_map_get(map, sizeof(uint64_t));
+  if (number == NULL)
+    return -1;
+  memcpy(page, number, sizeof(uint64_t));
+  *time_ns = 0;
+  *tid = 0;
+  if (header->flags & TRACE_FLAG_TIMESTAMPS){
+    int length = trace_decode_stamp(clock, map->base + map->pos, map->base + map->size, time_ns, tid);
+    if (length < 0)
+      return -1;
+    trace_map_get(map, length);
+  }
+  return 0;
+}
+
+#endif /* _TRACE_MAP_H */